@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class SpinLock {
+public:
+    void lock() {
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+
+    bool try_lock() {
+        return !flag_.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock() {
+        flag_.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentHashMap {
+public:
+    struct Access {
+        std::lock_guard<SpinLock> guard;
+        Value& ref_to_value;
+    };
+
+    explicit ConcurrentHashMap(size_t shard_count) : shards_(std::max<size_t>(shard_count, 1)) {
+    }
+
+    Access operator[](const Key& key) {
+        Shard& shard = GetShard(key);
+        return {std::lock_guard(shard.lock), shard.contain[key]};
+    }
+
+    void Erase(const Key& key) {
+        Shard& shard = GetShard(key);
+        std::lock_guard guard(shard.lock);
+        shard.contain.erase(key);
+    }
+
+    std::unordered_map<Key, Value, Hash> BuildOrdinaryMap() {
+        std::unordered_map<Key, Value, Hash> result;
+        for (Shard& shard : shards_) {
+            std::lock_guard guard(shard.lock);
+            result.merge(shard.contain);
+        }
+        return result;
+    }
+
+    template <typename ExecutionPolicy, typename Function>
+    void Drain(ExecutionPolicy&& policy, Function function) {
+        std::for_each(policy, shards_.begin(), shards_.end(), [&function](Shard& shard) {
+            std::unordered_map<Key, Value, Hash> contain;
+            {
+                std::lock_guard guard(shard.lock);
+                contain.swap(shard.contain);
+            }
+            for (auto& [key, value] : contain) {
+                function(key, value);
+            }
+        });
+    }
+
+private:
+    // Each shard takes its own cache line so neighbouring locks do not share it
+    struct alignas(64) Shard {
+        SpinLock lock;
+        std::unordered_map<Key, Value, Hash> contain;
+    };
+
+    std::vector<Shard> shards_;
+    Hash hasher_;
+
+    Shard& GetShard(const Key& key) {
+        return shards_[hasher_(key) % shards_.size()];
+    }
+};
\ No newline at end of file
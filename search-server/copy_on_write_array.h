@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// An array kept in chunks of fixed size that its copies share, so a copy costs a pointer per chunk. A copy clones
+// a chunk before it changes a value in it while another copy still holds the chunk. Copies may be read on other threads
+// while one of them changes, but only the thread that changes a copy may copy it
+template <typename T>
+class CopyOnWriteArray {
+public:
+    size_t size() const {
+        return size_;
+    }
+
+    const T& operator[](size_t index) const {
+        return (*chunks_[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+    }
+
+    T& GetMutable(size_t index) {
+        return GetMutableChunk(index / CHUNK_SIZE)[index % CHUNK_SIZE];
+    }
+
+    void push_back(const T& value) {
+        if (size_ % CHUNK_SIZE == 0) {
+            chunks_.push_back(std::make_shared<Chunk>());
+        }
+        GetMutableChunk(size_ / CHUNK_SIZE)[size_ % CHUNK_SIZE] = value;
+        ++size_;
+    }
+
+    void reserve(size_t size) {
+        chunks_.reserve((size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    }
+
+private:
+    static const size_t CHUNK_SIZE = 1024;
+    using Chunk = std::array<T, CHUNK_SIZE>;
+
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+    size_t size_ = 0;
+
+    Chunk& GetMutableChunk(size_t chunk) {
+        // Other copies are made on this thread, so one seen alone cannot gain another owner meanwhile
+        if (chunks_[chunk].use_count() > 1) {
+            chunks_[chunk] = std::make_shared<Chunk>(*chunks_[chunk]);
+        }
+        return *chunks_[chunk];
+    }
+};
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include "corpus_loader.h"
+#include "bounded_queue.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std::string_literals;
+
+namespace {
+
+int ParseInt(std::string_view text) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid number "s + std::string(text));
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text) {
+    static const std::string_view names[] = {"ACTUAL", "IRRELEVANT", "BANNED", "REMOVED"};
+    for (size_t status = 0; status < std::size(names); ++status) {
+        if (text == names[status] || (text.size() == 1 && text[0] == static_cast<char>('0' + status))) {
+            return static_cast<DocumentStatus>(status);
+        }
+    }
+    throw std::invalid_argument("Invalid status "s + std::string(text));
+}
+
+std::string_view NextField(std::string_view& line, char separator) {
+    const size_t end = std::min(line.find(separator), line.size());
+    const std::string_view field = line.substr(0, end);
+    line.remove_prefix(std::min(end + 1, line.size()));
+    return field;
+}
+
+void ParseTsvLine(std::string_view line, SearchServer::DocumentInput& document) {
+    if (std::count(line.begin(), line.end(), '\t') < 3) {
+        throw std::invalid_argument("Expected id, status, ratings and text separated by tabs"s);
+    }
+    document.id = ParseInt(NextField(line, '\t'));
+    document.status = ParseStatus(NextField(line, '\t'));
+    std::string_view ratings = NextField(line, '\t');
+    while (!ratings.empty()) {
+        const size_t end = std::min(ratings.find_first_of(" ,"), ratings.size());
+        if (end > 0) {
+            document.ratings.push_back(ParseInt(ratings.substr(0, end)));
+        }
+        ratings.remove_prefix(std::min(end + 1, ratings.size()));
+    }
+    document.text = line;
+}
+
+// Parses one object per line; strings without escapes are views of the line, others are decoded into decoded_text,
+// which has room for the whole chunk and so never moves
+class JsonLineParser {
+public:
+    JsonLineParser(std::string_view line, std::vector<char>& decoded_text)
+        : text_(line)
+        , decoded_text_(decoded_text) {
+    }
+
+    void Parse(SearchServer::DocumentInput& document) {
+        bool has_id = false;
+        Expect('{');
+        if (!Consume('}')) {
+            do {
+                const std::string_view key = ParseString();
+                Expect(':');
+                if (key == "id") {
+                    document.id = ParseNumber();
+                    has_id = true;
+                } else if (key == "status") {
+                    SkipSpaces();
+                    document.status = ParseStatus(Peek() == '"' ? ParseString() : ParseToken());
+                } else if (key == "ratings") {
+                    Expect('[');
+                    if (!Consume(']')) {
+                        do {
+                            document.ratings.push_back(ParseNumber());
+                        } while (Consume(','));
+                        Expect(']');
+                    }
+                } else if (key == "text") {
+                    document.text = ParseString();
+                } else {
+                    SkipValue();
+                }
+            } while (Consume(','));
+            Expect('}');
+        }
+        SkipSpaces();
+        if (position_ != text_.size()) {
+            throw std::invalid_argument("Unexpected characters after the object"s);
+        }
+        if (!has_id) {
+            throw std::invalid_argument("Missing document id"s);
+        }
+    }
+
+private:
+    std::string_view text_;
+    size_t position_ = 0;
+    std::vector<char>& decoded_text_;
+
+    char Peek() const {
+        return position_ < text_.size() ? text_[position_] : '\0';
+    }
+
+    void SkipSpaces() {
+        while (position_ < text_.size() && (text_[position_] == ' ' || text_[position_] == '\t' || text_[position_] == '\r')) {
+            ++position_;
+        }
+    }
+
+    bool Consume(char c) {
+        SkipSpaces();
+        if (Peek() != c) {
+            return false;
+        }
+        ++position_;
+        return true;
+    }
+
+    void Expect(char c) {
+        if (!Consume(c)) {
+            throw std::invalid_argument("Expected '"s + c + "' at column "s + std::to_string(position_ + 1));
+        }
+    }
+
+    std::string_view ParseToken() {
+        SkipSpaces();
+        const size_t first = position_;
+        while (position_ < text_.size() && std::strchr(",:]} \t\r", text_[position_]) == nullptr) {
+            ++position_;
+        }
+        return text_.substr(first, position_ - first);
+    }
+
+    int ParseNumber() {
+        return ParseInt(ParseToken());
+    }
+
+    std::string_view ParseString() {
+        Expect('"');
+        const size_t first = position_;
+        while (position_ < text_.size() && text_[position_] != '"' && text_[position_] != '\\') {
+            ++position_;
+        }
+        if (Peek() == '"') {
+            return text_.substr(first, position_++ - first);
+        }
+        const size_t decoded_first = decoded_text_.size();
+        decoded_text_.insert(decoded_text_.end(), text_.begin() + first, text_.begin() + position_);
+        while (position_ < text_.size() && text_[position_] != '"') {
+            if (text_[position_] != '\\') {
+                decoded_text_.push_back(text_[position_++]);
+                continue;
+            }
+            if (++position_ == text_.size()) {
+                break;
+            }
+            const char escape = text_[position_++];
+            switch (escape) {
+                case '"':
+                case '\\':
+                case '/':
+                    decoded_text_.push_back(escape);
+                    break;
+                // Words are separated by spaces only, so escaped whitespace becomes a space
+                case 'n':
+                case 'r':
+                case 't':
+                    decoded_text_.push_back(' ');
+                    break;
+                case 'b':
+                    decoded_text_.push_back('\b');
+                    break;
+                case 'f':
+                    decoded_text_.push_back('\f');
+                    break;
+                case 'u':
+                    AppendUtf8(ParseCodePoint());
+                    break;
+                default:
+                    throw std::invalid_argument("Invalid escape \\"s + escape);
+            }
+        }
+        if (position_++ == text_.size()) {
+            throw std::invalid_argument("Unterminated string"s);
+        }
+        return {decoded_text_.data() + decoded_first, decoded_text_.size() - decoded_first};
+    }
+
+    unsigned ParseHex() {
+        unsigned value = 0;
+        if (position_ + 4 > text_.size() || std::from_chars(text_.data() + position_, text_.data() + position_ + 4, value, 16).ptr
+                                                 != text_.data() + position_ + 4) {
+            throw std::invalid_argument("Invalid \\u escape"s);
+        }
+        position_ += 4;
+        return value;
+    }
+
+    unsigned ParseCodePoint() {
+        const unsigned code = ParseHex();
+        if (code < 0xD800 || code > 0xDFFF) {
+            return code;
+        }
+        if (code > 0xDBFF || text_.substr(position_, 2) != "\\u") {
+            throw std::invalid_argument("Invalid surrogate pair"s);
+        }
+        position_ += 2;
+        const unsigned low = ParseHex();
+        if (low < 0xDC00 || low > 0xDFFF) {
+            throw std::invalid_argument("Invalid surrogate pair"s);
+        }
+        return 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    void AppendUtf8(unsigned code) {
+        if (code < 0x80) {
+            decoded_text_.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            decoded_text_.push_back(static_cast<char>(0xC0 | code >> 6));
+            decoded_text_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            decoded_text_.push_back(static_cast<char>(0xE0 | code >> 12));
+            decoded_text_.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+            decoded_text_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            decoded_text_.push_back(static_cast<char>(0xF0 | code >> 18));
+            decoded_text_.push_back(static_cast<char>(0x80 | (code >> 12 & 0x3F)));
+            decoded_text_.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+            decoded_text_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    void SkipValue() {
+        SkipSpaces();
+        if (Peek() == '"') {
+            // Decoding is only wasted space in decoded_text_, which is sized for the whole chunk anyway
+            ParseString();
+        } else if (Consume('[')) {
+            if (!Consume(']')) {
+                do {
+                    SkipValue();
+                } while (Consume(','));
+                Expect(']');
+            }
+        } else if (Consume('{')) {
+            if (!Consume('}')) {
+                do {
+                    ParseString();
+                    Expect(':');
+                    SkipValue();
+                } while (Consume(','));
+                Expect('}');
+            }
+        } else if (ParseToken().empty()) {
+            throw std::invalid_argument("Expected a value at column "s + std::to_string(position_ + 1));
+        }
+    }
+};
+
+}
+
+CorpusReader::CorpusReader(std::istream& input, CorpusFormat format, size_t chunk_size)
+    : input_(input)
+    , format_(format)
+    , chunk_size_(std::max<size_t>(chunk_size, 1)) {
+}
+
+bool CorpusReader::ReadBatch(CorpusBatch& batch) {
+    batch.text.swap(rest_);
+    rest_.clear();
+    batch.decoded_text.clear();
+    batch.documents.clear();
+    batch.lines.clear();
+    batch.errors.clear();
+
+    // Reads until the chunk holds a line break or the input ends; the text after the last line break waits for the next chunk
+    size_t end = 0;
+    while (input_) {
+        const size_t size = batch.text.size();
+        batch.text.resize(size + chunk_size_);
+        input_.read(batch.text.data() + size, static_cast<std::streamsize>(chunk_size_));
+        batch.text.resize(size + static_cast<size_t>(input_.gcount()));
+        const auto line_break = std::find(batch.text.rbegin(), batch.text.rend() - size, '\n');
+        if (line_break != batch.text.rend() - size) {
+            end = batch.text.rend() - line_break;
+            break;
+        }
+    }
+    if (!input_) {
+        end = batch.text.size();
+    }
+    rest_.assign(batch.text.begin() + end, batch.text.end());
+    batch.text.resize(end);
+    if (batch.text.empty()) {
+        return false;
+    }
+
+    batch.decoded_text.reserve(batch.text.size());
+    std::string_view text(batch.text.data(), batch.text.size());
+    while (!text.empty()) {
+        std::string_view line = NextField(text, '\n');
+        ++line_;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.find_first_not_of(" \t") != std::string_view::npos) {
+            ParseLine(line, batch);
+        }
+    }
+    return true;
+}
+
+void CorpusReader::ParseLine(std::string_view line, CorpusBatch& batch) const {
+    SearchServer::DocumentInput document{-1, {}, DocumentStatus::ACTUAL, {}};
+    try {
+        if (format_ == CorpusFormat::TSV) {
+            ParseTsvLine(line, document);
+        } else {
+            JsonLineParser(line, batch.decoded_text).Parse(document);
+        }
+    } catch (const std::invalid_argument& error) {
+        batch.errors.push_back({line_, document.id, error.what()});
+        return;
+    }
+    batch.documents.push_back(std::move(document));
+    batch.lines.push_back(line_);
+}
+
+std::vector<SearchServer::DocumentError> LoadCorpus(SearchServer& search_server, std::istream& input, CorpusFormat format,
+                                                    size_t chunk_size, size_t queue_capacity) {
+    BoundedQueue<CorpusBatch> batches(std::max<size_t>(queue_capacity, 1));
+    std::exception_ptr read_error;
+    std::thread reader_thread([&] {
+        try {
+            CorpusReader reader(input, format, chunk_size);
+            CorpusBatch batch;
+            while (reader.ReadBatch(batch) && batches.Push(std::move(batch))) {
+                batch = CorpusBatch();
+            }
+        } catch (...) {
+            read_error = std::current_exception();
+        }
+        batches.Close();
+    });
+
+    std::vector<SearchServer::DocumentError> errors;
+    try {
+        while (std::optional<CorpusBatch> batch = batches.Pop()) {
+            std::move(batch->errors.begin(), batch->errors.end(), std::back_inserter(errors));
+            for (SearchServer::DocumentError& error : search_server.AddDocuments(batch->documents)) {
+                error.position = batch->lines[error.position];
+                errors.push_back(std::move(error));
+            }
+        }
+    } catch (...) {
+        batches.Close();
+        reader_thread.join();
+        throw;
+    }
+    reader_thread.join();
+    if (read_error) {
+        std::rethrow_exception(read_error);
+    }
+    std::sort(errors.begin(), errors.end(), [](const SearchServer::DocumentError& lhs, const SearchServer::DocumentError& rhs) {
+        return lhs.position < rhs.position;
+    });
+    return errors;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include "search_server.h"
+
+#include <cstddef>
+#include <istream>
+#include <string_view>
+#include <vector>
+
+enum class CorpusFormat {
+    // id, status, ratings and text separated by tabs; ratings separated by spaces or commas
+    TSV,
+    // One JSON object per line with "id", "status", "ratings" and "text"; other keys are skipped
+    JSONL,
+};
+
+// The whole lines of one chunk of a corpus. Documents view the chunk, or the decoded copy of JSON strings with escapes,
+// so they are valid as long as the batch
+struct CorpusBatch {
+    std::vector<char> text;
+    std::vector<char> decoded_text;
+    std::vector<SearchServer::DocumentInput> documents;
+    // The line number of each document
+    std::vector<size_t> lines;
+    // Lines that could not be parsed, positioned by line number
+    std::vector<SearchServer::DocumentError> errors;
+};
+
+class CorpusReader {
+public:
+    CorpusReader(std::istream& input, CorpusFormat format, size_t chunk_size = 4 << 20);
+
+    // Reads a chunk and parses its whole lines; a line longer than the chunk extends it. False at the end of the input
+    bool ReadBatch(CorpusBatch& batch);
+
+private:
+    std::istream& input_;
+    CorpusFormat format_;
+    size_t chunk_size_;
+    // The incomplete last line of the previous chunk
+    std::vector<char> rest_;
+    size_t line_ = 0;
+
+    void ParseLine(std::string_view line, CorpusBatch& batch) const;
+};
+
+// Reads the corpus on a separate thread while the calling thread indexes it. At most queue_capacity parsed chunks wait
+// for indexing, so memory does not grow with the corpus. Errors are positioned by line number
+std::vector<SearchServer::DocumentError> LoadCorpus(SearchServer& search_server, std::istream& input, CorpusFormat format,
+                                                    size_t chunk_size = 4 << 20, size_t queue_capacity = 2);
\ No newline at end of file
@@ -22,4 +22,10 @@ enum class DocumentStatus {
     IRRELEVANT,
     BANNED,
     REMOVED,
+};
+
+struct DocumentData {
+    int id;
+    int rating;
+    DocumentStatus status;
 };
\ No newline at end of file
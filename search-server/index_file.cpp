@@ -0,0 +1,218 @@
+#include "index_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t format_version;
+    // Tells a file written on a machine with another byte order
+    uint32_t byte_order;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+const char INDEX_FILE_MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+uint64_t MixChecksum(uint64_t checksum, uint64_t word) {
+    checksum ^= word;
+    return (checksum << 31 | checksum >> 33) * 0x9e3779b97f4a7c15ULL;
+}
+
+// Four independent lanes over the 8-byte words keep the multiplications from waiting on each other
+uint64_t ComputeChecksum(const char* data, size_t size) {
+    uint64_t lanes[4] = {1, 2, 3, 4};
+    const size_t word_count = size / 8;
+    size_t word = 0;
+    for (; word + 4 <= word_count; word += 4) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint64_t value;
+            std::memcpy(&value, data + (word + lane) * 8, 8);
+            lanes[lane] = MixChecksum(lanes[lane], value);
+        }
+    }
+    for (; word < word_count; ++word) {
+        uint64_t value;
+        std::memcpy(&value, data + word * 8, 8);
+        lanes[word % 4] = MixChecksum(lanes[word % 4], value);
+    }
+    uint64_t checksum = size;
+    for (const uint64_t lane : lanes) {
+        checksum = MixChecksum(checksum, lane);
+    }
+    return checksum;
+}
+
+}
+
+MappedFile::MappedFile(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Cannot open index file "s + path);
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        throw std::runtime_error("Cannot open index file "s + path);
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ > 0) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        // The checksum reads every page anyway
+        flags |= MAP_POPULATE;
+#endif
+        void* data = mmap(nullptr, size_, PROT_READ, flags, descriptor, 0);
+        if (data == MAP_FAILED) {
+            close(descriptor);
+            throw std::runtime_error("Cannot map index file "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    close(descriptor);
+#else
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input) {
+        throw std::runtime_error("Cannot open index file "s + path);
+    }
+    size_ = static_cast<size_t>(input.tellg());
+    buffer_.resize((size_ + 7) / 8);
+    input.seekg(0);
+    input.read(reinterpret_cast<char*>(buffer_.data()), size_);
+    if (!input) {
+        throw std::runtime_error("Cannot read index file "s + path);
+    }
+    data_ = reinterpret_cast<const char*>(buffer_.data());
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+const char* MappedFile::GetData() const {
+    return data_;
+}
+
+size_t MappedFile::GetSize() const {
+    return size_;
+}
+
+IndexFileWriter::IndexFileWriter(const std::string& path)
+    : path_(path)
+    , temp_path_(path + ".tmp"s)
+    , output_(temp_path_, std::ios::binary | std::ios::trunc) {
+    if (!output_) {
+        throw std::runtime_error("Cannot create index file "s + temp_path_);
+    }
+    const IndexFileHeader header{};
+    output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+IndexFileWriter::~IndexFileWriter() {
+    if (!finished_) {
+        output_.close();
+        std::remove(temp_path_.c_str());
+    }
+}
+
+void IndexFileWriter::WriteString(std::string_view text) {
+    WriteArray(text.data(), text.size());
+}
+
+void IndexFileWriter::Finish() {
+    output_.close();
+    if (!output_) {
+        throw std::runtime_error("Cannot write index file "s + temp_path_);
+    }
+    IndexFileHeader header{};
+    std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.format_version = INDEX_FORMAT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.payload_size = payload_size_;
+    {
+        const MappedFile file(temp_path_);
+        header.checksum = ComputeChecksum(file.GetData() + sizeof(IndexFileHeader), payload_size_);
+    }
+    std::fstream output(temp_path_, std::ios::binary | std::ios::in | std::ios::out);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    if (!output) {
+        throw std::runtime_error("Cannot write index file "s + temp_path_);
+    }
+    std::filesystem::rename(temp_path_, path_);
+    finished_ = true;
+}
+
+void IndexFileWriter::WriteBytes(const void* data, size_t size) {
+    static const char padding[8] = {};
+    const size_t padded_size = (size + 7) / 8 * 8;
+    output_.write(static_cast<const char*>(data), size);
+    output_.write(padding, padded_size - size);
+    payload_size_ += padded_size;
+}
+
+IndexFileReader::IndexFileReader(const std::string& path)
+    : file_(std::make_shared<const MappedFile>(path))
+    , position_(sizeof(IndexFileHeader)) {
+    if (file_->GetSize() < sizeof(IndexFileHeader)) {
+        throw std::runtime_error("Index file is truncated"s);
+    }
+    IndexFileHeader header;
+    std::memcpy(&header, file_->GetData(), sizeof(header));
+    if (std::memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not an index file"s);
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("Index file was written with another byte order"s);
+    }
+    if (header.format_version != INDEX_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported index format version "s + std::to_string(header.format_version));
+    }
+    if (header.payload_size != file_->GetSize() - sizeof(IndexFileHeader)) {
+        throw std::runtime_error("Index file is truncated"s);
+    }
+    if (ComputeChecksum(file_->GetData() + sizeof(IndexFileHeader), header.payload_size) != header.checksum) {
+        throw std::runtime_error("Index file checksum mismatch"s);
+    }
+}
+
+std::string_view IndexFileReader::ReadString() {
+    const MappedArray<char> text = ReadArray<char>();
+    return {text.data(), text.size()};
+}
+
+const std::shared_ptr<const MappedFile>& IndexFileReader::GetFile() const {
+    return file_;
+}
+
+size_t IndexFileReader::GetRemainingSize() const {
+    return file_->GetSize() - position_;
+}
+
+const char* IndexFileReader::ReadBytes(size_t size) {
+    if (size > GetRemainingSize()) {
+        throw std::runtime_error("Index file is truncated"s);
+    }
+    const char* data = file_->GetData() + position_;
+    position_ = std::min(position_ + (size + 7) / 8 * 8, file_->GetSize());
+    return data;
+}
\ No newline at end of file
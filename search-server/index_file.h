@@ -0,0 +1,110 @@
+#pragma once
+#include "mapped_array.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// An index file is a header with the format version and a checksum of the payload, then the payload: values and
+// arrays in native byte order, each padded to 8 bytes so that arrays can be used in place from the mapped file
+const uint32_t INDEX_FORMAT_VERSION = 3;
+
+// The contents of a file, mapped into memory read-only where the platform allows it and read otherwise
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* GetData() const;
+    size_t GetSize() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<uint64_t> buffer_;
+};
+
+// Writes to a temporary file next to the target; Finish fills in the header and moves the file over the target
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(const std::string& path);
+    IndexFileWriter(const IndexFileWriter&) = delete;
+    IndexFileWriter& operator=(const IndexFileWriter&) = delete;
+    // Removes the temporary file unless Finish succeeded
+    ~IndexFileWriter();
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t size) {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+        WriteValue<uint64_t>(size);
+        WriteBytes(data, size * sizeof(T));
+    }
+
+    template <typename Container>
+    void WriteArray(const Container& values) {
+        WriteArray(values.data(), values.size());
+    }
+
+    void WriteString(std::string_view text);
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream output_;
+    uint64_t payload_size_ = 0;
+    bool finished_ = false;
+
+    void WriteBytes(const void* data, size_t size);
+};
+
+// Maps the file and validates its header and checksum; arrays read from it view the mapped memory
+class IndexFileReader {
+public:
+    explicit IndexFileReader(const std::string& path);
+
+    template <typename T>
+    T ReadValue() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    MappedArray<T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8);
+        const uint64_t size = ReadValue<uint64_t>();
+        if (size > GetRemainingSize() / sizeof(T)) {
+            using namespace std::string_literals;
+            throw std::runtime_error("Index file is truncated"s);
+        }
+        return MappedArray<T>(reinterpret_cast<const T*>(ReadBytes(size * sizeof(T))), size);
+    }
+
+    std::string_view ReadString();
+
+    // Objects that view the file keep it mapped by holding this pointer
+    const std::shared_ptr<const MappedFile>& GetFile() const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_;
+
+    size_t GetRemainingSize() const;
+    const char* ReadBytes(size_t size);
+};
\ No newline at end of file
@@ -0,0 +1,533 @@
+#include "index_segment.h"
+#include "query_profile.h"
+
+#include <algorithm>
+#include <array>
+#include <execution>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+
+namespace {
+
+// Decoding looks the inverse up for the common short documents; the value is the same as 1.0 / word_count
+constexpr std::array<double, 4096> INVERSE_WORD_COUNTS = [] {
+    std::array<double, 4096> result{};
+    for (size_t word_count = 1; word_count < result.size(); ++word_count) {
+        result[word_count] = 1.0 / word_count;
+    }
+    return result;
+}();
+
+double GetInverseWordCount(int word_count) {
+    return static_cast<size_t>(word_count) < INVERSE_WORD_COUNTS.size() ? INVERSE_WORD_COUNTS[word_count] : 1.0 / word_count;
+}
+
+}
+
+IndexSegment::IndexSegment()
+    : storage_(std::make_shared<Storage>()) {
+}
+
+IndexSegment::IndexSegment(const IndexSegment& other)
+    : storage_(other.sealed_ || other.frozen_ ? other.storage_ : std::make_shared<Storage>(*other.storage_))
+    , sealed_(other.sealed_)
+    , frozen_(other.frozen_) {
+}
+
+IndexSegment& IndexSegment::operator=(const IndexSegment& other) {
+    if (this != &other) {
+        *this = IndexSegment(other);
+    }
+    return *this;
+}
+
+int IndexSegment::AddDocument(const DocumentData& document, const std::vector<std::pair<TermId, int>>& term_counts) {
+    Storage& storage = *storage_;
+    const int ordinal = static_cast<int>(storage.documents.size());
+    int word_count = 0;
+    for (const auto& [term_id, count] : term_counts) {
+        word_count += count;
+    }
+    const double inv_word_count = 1.0 / word_count;
+    storage.documents.push_back(document);
+    storage.word_counts.push_back(word_count);
+    storage.ordinals_by_id[document.id] = ordinal;
+    for (const auto& [term_id, count] : term_counts) {
+        PostingList& postings = storage.postings[term_id];
+        const double term_freq = count * inv_word_count;
+        postings.ordinals.push_back(ordinal);
+        postings.counts.push_back(count);
+        postings.term_freqs.push_back(term_freq);
+        postings.max_term_freq = std::max(postings.max_term_freq, term_freq);
+        storage.document_terms.push_back(term_id);
+        storage.document_term_counts.push_back(count);
+    }
+    storage.document_term_offsets.push_back(storage.document_terms.size());
+    return ordinal;
+}
+
+IndexSegment IndexSegment::Build(std::vector<DocumentData> documents, const std::vector<std::vector<Posting>>& parts, TermId term_count) {
+    IndexSegment segment;
+    segment.sealed_ = true;
+    Storage& storage = *segment.storage_;
+    const size_t document_count = documents.size();
+    std::vector<DocumentOrdinal> sorted_ids;
+    sorted_ids.reserve(document_count);
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        sorted_ids.push_back({documents[ordinal].id, static_cast<int>(ordinal)});
+    }
+    std::sort(sorted_ids.begin(), sorted_ids.end(), [](const DocumentOrdinal& lhs, const DocumentOrdinal& rhs) {
+        return std::tie(lhs.id, lhs.ordinal) < std::tie(rhs.id, rhs.ordinal);
+    });
+
+    // The parts hold disjoint documents, so each one fills the forward index of its own documents
+    std::vector<size_t> part_indexes(parts.size());
+    std::iota(part_indexes.begin(), part_indexes.end(), 0);
+    std::vector<size_t> document_term_offsets(document_count + 1, 0);
+    std::for_each(std::execution::par, part_indexes.begin(), part_indexes.end(), [&](const size_t part) {
+        for (const Posting& posting : parts[part]) {
+            ++document_term_offsets[posting.ordinal + 1];
+        }
+    });
+    std::partial_sum(document_term_offsets.begin(), document_term_offsets.end(), document_term_offsets.begin());
+    std::vector<TermId> document_terms(document_term_offsets.back());
+    std::vector<int> document_term_counts(document_terms.size());
+    std::vector<int> word_counts(document_count, 0);
+    std::vector<size_t> term_positions(document_term_offsets.begin(), document_term_offsets.end() - 1);
+    std::for_each(std::execution::par, part_indexes.begin(), part_indexes.end(), [&](const size_t part) {
+        for (const Posting& posting : parts[part]) {
+            const size_t position = term_positions[posting.ordinal]++;
+            document_terms[position] = posting.term_id;
+            document_term_counts[position] = posting.count;
+            word_counts[posting.ordinal] += posting.count;
+        }
+    });
+
+    // Every term range is handled by one worker, which walks the parts in order so postings stay sorted
+    const int range_count = std::max(1, std::min(static_cast<int>(term_count), static_cast<int>(std::thread::hardware_concurrency()) * 4));
+    std::vector<int> ranges(range_count);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    const auto get_term_range = [term_count, range_count](const int range) {
+        return std::pair{static_cast<TermId>(static_cast<int64_t>(term_count) * range / range_count),
+                         static_cast<TermId>(static_cast<int64_t>(term_count) * (range + 1) / range_count)};
+    };
+    const auto for_each_posting = [&parts, &get_term_range](const int range, auto function) {
+        const auto [first_term, last_term] = get_term_range(range);
+        for (const std::vector<Posting>& postings : parts) {
+            auto iterator = std::lower_bound(postings.begin(), postings.end(), first_term, [](const Posting& posting, TermId term_id) {
+                return posting.term_id < term_id;
+            });
+            for (; iterator != postings.end() && iterator->term_id < last_term; ++iterator) {
+                function(*iterator);
+            }
+        }
+    };
+
+    std::vector<size_t> posting_offsets(term_count + 1, 0);
+    std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](const int range) {
+        for_each_posting(range, [&posting_offsets](const Posting& posting) {
+            ++posting_offsets[posting.term_id + 1];
+        });
+    });
+    std::partial_sum(posting_offsets.begin(), posting_offsets.end(), posting_offsets.begin());
+    std::vector<size_t> block_offsets(term_count + 1, 0);
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        const size_t posting_count = posting_offsets[term_id + 1] - posting_offsets[term_id];
+        block_offsets[term_id + 1] = block_offsets[term_id] + (posting_count + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    }
+
+    // Block positions are known up front; block data is packed per range and concatenated afterwards
+    const size_t block_count = block_offsets.back();
+    std::vector<int> block_first_ordinals(block_count);
+    std::vector<int> block_last_ordinals(block_count);
+    std::vector<size_t> block_data_offsets(block_count);
+    std::vector<uint8_t> block_delta_bits(block_count);
+    std::vector<uint8_t> block_count_bits(block_count);
+    std::vector<double> max_term_freqs(term_count, 0.0);
+    std::vector<std::vector<uint8_t>> range_data(range_count);
+    std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](const int range) {
+        const auto [first_term, last_term] = get_term_range(range);
+        const size_t first_posting = posting_offsets[first_term];
+        std::vector<int> ordinals(posting_offsets[last_term] - first_posting);
+        std::vector<int> counts(ordinals.size());
+        std::vector<size_t> positions(posting_offsets.begin() + first_term, posting_offsets.begin() + last_term);
+        for_each_posting(range, [&](const Posting& posting) {
+            const size_t position = positions[posting.term_id - first_term]++ - first_posting;
+            ordinals[position] = posting.ordinal;
+            counts[position] = posting.count;
+        });
+
+        std::vector<uint8_t>& data = range_data[range];
+        int deltas[POSTING_BLOCK_SIZE];
+        int block_counts[POSTING_BLOCK_SIZE];
+        for (TermId term_id = first_term; term_id < last_term; ++term_id) {
+            const size_t term_first = posting_offsets[term_id] - first_posting;
+            const size_t term_last = posting_offsets[term_id + 1] - first_posting;
+            size_t block = block_offsets[term_id];
+            for (size_t first = term_first; first < term_last; first += POSTING_BLOCK_SIZE, ++block) {
+                const size_t size = std::min(POSTING_BLOCK_SIZE, term_last - first);
+                for (size_t i = 0; i < size; ++i) {
+                    deltas[i] = i == 0 ? 0 : ordinals[first + i] - ordinals[first + i - 1] - 1;
+                    block_counts[i] = counts[first + i] - 1;
+                    max_term_freqs[term_id] = std::max(max_term_freqs[term_id], counts[first + i] * GetInverseWordCount(word_counts[ordinals[first + i]]));
+                }
+                block_first_ordinals[block] = ordinals[first];
+                block_last_ordinals[block] = ordinals[first + size - 1];
+                block_data_offsets[block] = data.size();
+                block_delta_bits[block] = static_cast<uint8_t>(PackBits(deltas, size, data));
+                block_count_bits[block] = static_cast<uint8_t>(PackBits(block_counts, size, data));
+            }
+        }
+    });
+
+    std::vector<size_t> range_data_offsets(range_count + 1, 0);
+    for (int range = 0; range < range_count; ++range) {
+        range_data_offsets[range + 1] = range_data_offsets[range] + range_data[range].size();
+    }
+    std::vector<uint8_t> data(range_data_offsets.back() + PACKED_DATA_PADDING, 0);
+    std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](const int range) {
+        const auto [first_term, last_term] = get_term_range(range);
+        std::copy(range_data[range].begin(), range_data[range].end(), data.begin() + range_data_offsets[range]);
+        for (size_t block = block_offsets[first_term]; block < block_offsets[last_term]; ++block) {
+            block_data_offsets[block] += range_data_offsets[range];
+        }
+    });
+
+    storage.documents = MappedArray<DocumentData>(std::move(documents));
+    storage.word_counts = MappedArray<int>(std::move(word_counts));
+    storage.document_term_offsets = MappedArray<size_t>(std::move(document_term_offsets));
+    storage.document_terms = MappedArray<TermId>(std::move(document_terms));
+    storage.document_term_counts = MappedArray<int>(std::move(document_term_counts));
+    storage.sorted_ids = MappedArray<DocumentOrdinal>(std::move(sorted_ids));
+    storage.posting_offsets = MappedArray<size_t>(std::move(posting_offsets));
+    storage.block_offsets = MappedArray<size_t>(std::move(block_offsets));
+    storage.block_first_ordinals = MappedArray<int>(std::move(block_first_ordinals));
+    storage.block_last_ordinals = MappedArray<int>(std::move(block_last_ordinals));
+    storage.block_data_offsets = MappedArray<size_t>(std::move(block_data_offsets));
+    storage.block_delta_bits = MappedArray<uint8_t>(std::move(block_delta_bits));
+    storage.block_count_bits = MappedArray<uint8_t>(std::move(block_count_bits));
+    storage.data = MappedArray<uint8_t>(std::move(data));
+    storage.max_term_freqs = MappedArray<double>(std::move(max_term_freqs));
+    return segment;
+}
+
+IndexSegment IndexSegment::Merge(const std::vector<const IndexSegment*>& sources, const std::vector<const std::vector<bool>*>& tombstones,
+                                 TermId term_count) {
+    std::vector<DocumentData> documents;
+    std::vector<std::vector<int>> new_ordinals(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const Storage& storage = *sources[i]->storage_;
+        new_ordinals[i].assign(storage.documents.size(), -1);
+        for (size_t ordinal = 0; ordinal < storage.documents.size(); ++ordinal) {
+            if (!(*tombstones[i])[ordinal]) {
+                new_ordinals[i][ordinal] = static_cast<int>(documents.size());
+                documents.push_back(storage.documents[ordinal]);
+            }
+        }
+    }
+
+    std::vector<std::vector<Posting>> parts(sources.size());
+    std::vector<size_t> indexes(sources.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](const size_t i) {
+        sources[i]->CollectPostings(new_ordinals[i], parts[i]);
+    });
+    return Build(std::move(documents), parts, term_count);
+}
+
+IndexSegment IndexSegment::MergeFrozen(const std::vector<const IndexSegment*>& sources, const std::vector<const std::vector<bool>*>& tombstones) {
+    IndexSegment segment;
+    std::vector<std::pair<TermId, int>> term_counts;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        for (int ordinal = 0; ordinal < sources[i]->GetDocumentCount(); ++ordinal) {
+            if ((*tombstones[i])[ordinal]) {
+                continue;
+            }
+            term_counts.clear();
+            sources[i]->ForEachTerm(ordinal, [&term_counts](TermId term_id, int count) {
+                term_counts.push_back({term_id, count});
+            });
+            segment.AddDocument(sources[i]->GetDocument(ordinal), term_counts);
+        }
+    }
+    segment.Freeze();
+    return segment;
+}
+
+void IndexSegment::Freeze() {
+    frozen_ = true;
+}
+
+bool IndexSegment::IsFrozen() const {
+    return frozen_;
+}
+
+bool IndexSegment::IsSealed() const {
+    return sealed_;
+}
+
+int IndexSegment::GetDocumentCount() const {
+    return static_cast<int>(storage_->documents.size());
+}
+
+const DocumentData& IndexSegment::GetDocument(int ordinal) const {
+    return storage_->documents[ordinal];
+}
+
+std::map<std::string_view, double> IndexSegment::ComputeWordFrequencies(int ordinal, const TermDictionary& dictionary) const {
+    std::map<std::string_view, double> word_freqs;
+    const double inv_word_count = 1.0 / storage_->word_counts[ordinal];
+    ForEachTerm(ordinal, [&dictionary, &word_freqs, inv_word_count](TermId term_id, int count) {
+        word_freqs.emplace(dictionary.GetTerm(term_id), count * inv_word_count);
+    });
+    return word_freqs;
+}
+
+int IndexSegment::FindOrdinal(int document_id) const {
+    const Storage& storage = *storage_;
+    if (!sealed_) {
+        const auto iterator = storage.ordinals_by_id.find(document_id);
+        return iterator == storage.ordinals_by_id.end() ? -1 : iterator->second;
+    }
+    const auto iterator = std::lower_bound(storage.sorted_ids.begin(), storage.sorted_ids.end(), document_id,
+                                           [](const DocumentOrdinal& entry, int id) {
+                                               return entry.id < id;
+                                           });
+    return iterator == storage.sorted_ids.end() || iterator->id != document_id ? -1 : iterator->ordinal;
+}
+
+PostingsCursor IndexSegment::GetPostings(TermId term_id, int first_ordinal) const {
+    const Storage& storage = *storage_;
+    PostingsCursor cursor;
+    cursor.storage_ = &storage;
+    if (term_id == TermDictionary::NO_TERM) {
+        return cursor;
+    }
+    if (!sealed_) {
+        const auto iterator = storage.postings.find(term_id);
+        if (iterator == storage.postings.end()) {
+            return cursor;
+        }
+        cursor.postings_ = &iterator->second;
+        cursor.posting_count_ = iterator->second.ordinals.size();
+        cursor.end_block_ = (cursor.posting_count_ + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    } else {
+        if (static_cast<size_t>(term_id) + 1 >= storage.posting_offsets.size()) {
+            return cursor;
+        }
+        cursor.posting_count_ = storage.posting_offsets[term_id + 1] - storage.posting_offsets[term_id];
+        cursor.first_block_ = storage.block_offsets[term_id];
+        cursor.end_block_ = storage.block_offsets[term_id + 1];
+    }
+    cursor.LoadBlock(first_ordinal > 0 ? cursor.FindBlock(cursor.first_block_, first_ordinal) : cursor.first_block_);
+    cursor.SkipTo(first_ordinal);
+    return cursor;
+}
+
+size_t IndexSegment::GetPostingCount(TermId term_id) const {
+    const Storage& storage = *storage_;
+    if (term_id == TermDictionary::NO_TERM) {
+        return 0;
+    }
+    if (!sealed_) {
+        const auto iterator = storage.postings.find(term_id);
+        return iterator == storage.postings.end() ? 0 : iterator->second.ordinals.size();
+    }
+    if (static_cast<size_t>(term_id) + 1 >= storage.posting_offsets.size()) {
+        return 0;
+    }
+    return storage.posting_offsets[term_id + 1] - storage.posting_offsets[term_id];
+}
+
+double IndexSegment::GetMaxTermFreq(TermId term_id) const {
+    const Storage& storage = *storage_;
+    if (term_id == TermDictionary::NO_TERM) {
+        return 0.0;
+    }
+    if (!sealed_) {
+        const auto iterator = storage.postings.find(term_id);
+        return iterator == storage.postings.end() ? 0.0 : iterator->second.max_term_freq;
+    }
+    return static_cast<size_t>(term_id) < storage.max_term_freqs.size() ? storage.max_term_freqs[term_id] : 0.0;
+}
+
+bool IndexSegment::Contains(TermId term_id, int ordinal) const {
+    const PostingsCursor postings = GetPostings(term_id, ordinal);
+    return !postings.IsEnd() && postings.GetOrdinal() == ordinal;
+}
+
+void IndexSegment::Save(IndexFileWriter& writer) const {
+    using namespace std::string_literals;
+    if (!sealed_) {
+        throw std::logic_error("Only sealed segments can be saved"s);
+    }
+    const Storage& storage = *storage_;
+    writer.WriteArray(storage.documents);
+    writer.WriteArray(storage.word_counts);
+    writer.WriteArray(storage.document_term_offsets);
+    writer.WriteArray(storage.document_terms);
+    writer.WriteArray(storage.document_term_counts);
+    writer.WriteArray(storage.sorted_ids);
+    writer.WriteArray(storage.posting_offsets);
+    writer.WriteArray(storage.block_offsets);
+    writer.WriteArray(storage.block_first_ordinals);
+    writer.WriteArray(storage.block_last_ordinals);
+    writer.WriteArray(storage.block_data_offsets);
+    writer.WriteArray(storage.block_delta_bits);
+    writer.WriteArray(storage.block_count_bits);
+    writer.WriteArray(storage.data);
+    writer.WriteArray(storage.max_term_freqs);
+}
+
+IndexSegment IndexSegment::Load(IndexFileReader& reader) {
+    using namespace std::string_literals;
+    IndexSegment segment;
+    segment.sealed_ = true;
+    Storage& storage = *segment.storage_;
+    storage.file = reader.GetFile();
+    storage.documents = reader.ReadArray<DocumentData>();
+    storage.word_counts = reader.ReadArray<int>();
+    storage.document_term_offsets = reader.ReadArray<size_t>();
+    storage.document_terms = reader.ReadArray<TermId>();
+    storage.document_term_counts = reader.ReadArray<int>();
+    storage.sorted_ids = reader.ReadArray<DocumentOrdinal>();
+    storage.posting_offsets = reader.ReadArray<size_t>();
+    storage.block_offsets = reader.ReadArray<size_t>();
+    storage.block_first_ordinals = reader.ReadArray<int>();
+    storage.block_last_ordinals = reader.ReadArray<int>();
+    storage.block_data_offsets = reader.ReadArray<size_t>();
+    storage.block_delta_bits = reader.ReadArray<uint8_t>();
+    storage.block_count_bits = reader.ReadArray<uint8_t>();
+    storage.data = reader.ReadArray<uint8_t>();
+    storage.max_term_freqs = reader.ReadArray<double>();
+    const size_t document_count = storage.documents.size();
+    const size_t block_count = storage.block_delta_bits.size();
+    if (storage.word_counts.size() != document_count || storage.sorted_ids.size() != document_count
+        || storage.document_term_offsets.size() != document_count + 1 || storage.document_term_counts.size() != storage.document_terms.size()
+        || storage.posting_offsets.empty() || storage.block_offsets.size() != storage.posting_offsets.size()
+        || storage.max_term_freqs.size() + 1 != storage.posting_offsets.size() || storage.block_offsets.back() != block_count
+        || storage.block_first_ordinals.size() != block_count || storage.block_last_ordinals.size() != block_count
+        || storage.block_data_offsets.size() != block_count || storage.block_count_bits.size() != block_count
+        || storage.data.size() < PACKED_DATA_PADDING) {
+        throw std::runtime_error("Index file has an inconsistent segment"s);
+    }
+    return segment;
+}
+
+void IndexSegment::DecodeBlock(const Storage& storage, size_t block, size_t size, int* ordinals, int* counts) {
+    const uint8_t* data = storage.data.data() + storage.block_data_offsets[block];
+    const int delta_bits = storage.block_delta_bits[block];
+    UnpackBits(data, delta_bits, size, ordinals);
+    PrefixSum(ordinals, size, storage.block_first_ordinals[block]);
+    for (size_t i = 0; i < size; ++i) {
+        ordinals[i] += static_cast<int>(i);
+    }
+    UnpackBits(data + GetPackedSize(delta_bits, size), storage.block_count_bits[block], size, counts);
+    for (size_t i = 0; i < size; ++i) {
+        ++counts[i];
+    }
+}
+
+void IndexSegment::CollectPostings(const std::vector<int>& new_ordinals, std::vector<Posting>& postings) const {
+    const Storage& storage = *storage_;
+    if (sealed_) {
+        int ordinals[POSTING_BLOCK_SIZE];
+        int counts[POSTING_BLOCK_SIZE];
+        for (size_t term_id = 0; term_id + 1 < storage.posting_offsets.size(); ++term_id) {
+            size_t remaining = storage.posting_offsets[term_id + 1] - storage.posting_offsets[term_id];
+            for (size_t block = storage.block_offsets[term_id]; block < storage.block_offsets[term_id + 1]; ++block) {
+                const size_t size = std::min(POSTING_BLOCK_SIZE, remaining);
+                remaining -= size;
+                DecodeBlock(storage, block, size, ordinals, counts);
+                for (size_t i = 0; i < size; ++i) {
+                    if (new_ordinals[ordinals[i]] >= 0) {
+                        postings.push_back({static_cast<TermId>(term_id), new_ordinals[ordinals[i]], counts[i]});
+                    }
+                }
+            }
+        }
+        return;
+    }
+    for (const auto& [term_id, term_postings] : storage.postings) {
+        for (size_t i = 0; i < term_postings.ordinals.size(); ++i) {
+            if (new_ordinals[term_postings.ordinals[i]] >= 0) {
+                postings.push_back({term_id, new_ordinals[term_postings.ordinals[i]], term_postings.counts[i]});
+            }
+        }
+    }
+    std::sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+        return std::tie(lhs.term_id, lhs.ordinal) < std::tie(rhs.term_id, rhs.ordinal);
+    });
+}
+
+void PostingsCursor::SkipTo(int ordinal) {
+    if (IsEnd() || GetOrdinal() >= ordinal) {
+        return;
+    }
+    if (GetBlockLastOrdinal(block_) < ordinal) {
+        LoadBlock(FindBlock(block_ + 1, ordinal));
+        if (IsEnd()) {
+            return;
+        }
+    }
+    int low = position_;
+    int high = position_ + 1;
+    for (int step = 2; high < block_size_ && ordinals_[high] < ordinal; step *= 2) {
+        low = high + 1;
+        high = low + step;
+    }
+    position_ = static_cast<int>(std::lower_bound(ordinals_ + low, ordinals_ + std::min(high, block_size_), ordinal) - ordinals_);
+}
+
+// The first block from the given one whose last ordinal is not less than ordinal, or end_block_
+size_t PostingsCursor::FindBlock(size_t block, int ordinal) const {
+    size_t low = block;
+    size_t high = block;
+    for (size_t step = 1; high < end_block_ && GetBlockLastOrdinal(high) < ordinal; step *= 2) {
+        low = high + 1;
+        high = low + step;
+    }
+    high = std::min(high, end_block_);
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (GetBlockLastOrdinal(middle) < ordinal) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int PostingsCursor::GetBlockLastOrdinal(size_t block) const {
+    if (postings_ == nullptr) {
+        return storage_->block_last_ordinals[block];
+    }
+    return postings_->ordinals[std::min(posting_count_, (block + 1) * POSTING_BLOCK_SIZE) - 1];
+}
+
+void PostingsCursor::LoadBlock(size_t block) {
+    block_ = block;
+    position_ = 0;
+    if (block >= end_block_) {
+        block_size_ = 0;
+        return;
+    }
+    const size_t first = (block - first_block_) * POSTING_BLOCK_SIZE;
+    block_size_ = static_cast<int>(std::min(POSTING_BLOCK_SIZE, posting_count_ - first));
+    CountQueryWork(QueryCounter::POSTINGS_SCANNED, block_size_);
+    if (postings_ != nullptr) {
+        std::copy_n(postings_->ordinals.begin() + first, block_size_, ordinals_);
+        std::copy_n(postings_->term_freqs.begin() + first, block_size_, term_freqs_);
+        return;
+    }
+    int counts[POSTING_BLOCK_SIZE];
+    IndexSegment::DecodeBlock(*storage_, block, block_size_, ordinals_, counts);
+    const MappedArray<int>& word_counts = storage_->word_counts;
+    for (int i = 0; i < block_size_; ++i) {
+        term_freqs_[i] = counts[i] * GetInverseWordCount(word_counts[ordinals_[i]]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#pragma once
+#include "document.h"
+#include "index_file.h"
+#include "mapped_array.h"
+#include "posting_codec.h"
+#include "term_dictionary.h"
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class PostingsCursor;
+
+// Documents added one after another together with their postings; ordinals are local to the segment.
+// A segment built with AddDocument stays mutable until it is frozen, and then shares its data with every copy.
+// Build and Merge produce sealed segments: immutable, with the postings of each term compressed in blocks, and
+// sharing their data with every copy. A loaded segment views the arrays of the mapped index file in place.
+// The term frequency of a posting is its count in the document times the inverse of the document word count
+class IndexSegment {
+public:
+    struct Posting {
+        TermId term_id;
+        int ordinal;
+        int count;
+    };
+
+    IndexSegment();
+    IndexSegment(const IndexSegment& other);
+    IndexSegment(IndexSegment&& other) = default;
+    IndexSegment& operator=(const IndexSegment& other);
+    IndexSegment& operator=(IndexSegment&& other) = default;
+
+    // term_counts must not repeat terms
+    int AddDocument(const DocumentData& document, const std::vector<std::pair<TermId, int>>& term_counts);
+
+    // Every part is sorted by term and ordinal and holds all postings of its documents, and for each term
+    // its ordinals precede those of the next part
+    static IndexSegment Build(std::vector<DocumentData> documents, const std::vector<std::vector<Posting>>& parts, TermId term_count);
+    // Keeps the documents of the sources that are not marked in their tombstones, in source order
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& sources, const std::vector<const std::vector<bool>*>& tombstones,
+                              TermId term_count);
+    // Like Merge, but the result keeps the layout of a mutable segment and is frozen. Sealed segments take arrays
+    // over the whole dictionary, which small ones are not worth
+    static IndexSegment MergeFrozen(const std::vector<const IndexSegment*>& sources, const std::vector<const std::vector<bool>*>& tombstones);
+
+    void Freeze();
+    bool IsFrozen() const;
+    bool IsSealed() const;
+    int GetDocumentCount() const;
+    const DocumentData& GetDocument(int ordinal) const;
+    std::map<std::string_view, double> ComputeWordFrequencies(int ordinal, const TermDictionary& dictionary) const;
+    // Calls function(term_id, count) for the terms of the document
+    template <typename Function>
+    void ForEachTerm(int ordinal, Function function) const;
+    // The ordinal of the latest document with this id, or -1
+    int FindOrdinal(int document_id) const;
+
+    // The cursor starts at the first posting with an ordinal not less than first_ordinal
+    PostingsCursor GetPostings(TermId term_id, int first_ordinal = 0) const;
+    size_t GetPostingCount(TermId term_id) const;
+    double GetMaxTermFreq(TermId term_id) const;
+    bool Contains(TermId term_id, int ordinal) const;
+
+    // Only sealed segments can be saved
+    void Save(IndexFileWriter& writer) const;
+    static IndexSegment Load(IndexFileReader& reader);
+
+private:
+    friend class PostingsCursor;
+
+    struct PostingList {
+        std::vector<int> ordinals;
+        std::vector<int> counts;
+        std::vector<double> term_freqs;
+        double max_term_freq = 0.0;
+    };
+
+    struct DocumentOrdinal {
+        int id;
+        int ordinal;
+    };
+
+    struct Storage {
+        MappedArray<DocumentData> documents;
+        MappedArray<int> word_counts;
+        // The terms of a document and their counts fill [document_term_offsets[ordinal], document_term_offsets[ordinal + 1])
+        MappedArray<size_t> document_term_offsets = MappedArray<size_t>(std::vector<size_t>(1, 0));
+        MappedArray<TermId> document_terms;
+        MappedArray<int> document_term_counts;
+        // Keeps the arrays of a loaded segment mapped
+        std::shared_ptr<const MappedFile> file;
+        // Mutable segments
+        std::unordered_map<int, int> ordinals_by_id;
+        std::unordered_map<TermId, PostingList> postings;
+        // Sealed segments: document ordinals sorted by id. The postings of a term, posting_offsets[term + 1] - posting_offsets[term]
+        // of them, fill the blocks [block_offsets[term], block_offsets[term + 1]), each full but the last. A block packs
+        // the ordinal deltas from its first ordinal less one and then the counts less one, each in as many bits as its widest
+        // value needs. Term frequencies take the word counts of the documents from word_counts
+        MappedArray<DocumentOrdinal> sorted_ids;
+        MappedArray<size_t> posting_offsets;
+        MappedArray<size_t> block_offsets;
+        MappedArray<int> block_first_ordinals;
+        MappedArray<int> block_last_ordinals;
+        MappedArray<size_t> block_data_offsets;
+        MappedArray<uint8_t> block_delta_bits;
+        MappedArray<uint8_t> block_count_bits;
+        MappedArray<uint8_t> data;
+        MappedArray<double> max_term_freqs;
+    };
+
+    std::shared_ptr<Storage> storage_;
+    bool sealed_ = false;
+    bool frozen_ = false;
+
+    static void DecodeBlock(const Storage& storage, size_t block, size_t size, int* ordinals, int* counts);
+    void CollectPostings(const std::vector<int>& new_ordinals, std::vector<Posting>& postings) const;
+};
+
+// Walks the postings of a term in a segment in ordinal order, decoding one block at a time.
+// The segment must outlive the cursor
+class PostingsCursor {
+public:
+    PostingsCursor() = default;
+
+    bool IsEnd() const {
+        return position_ >= block_size_;
+    }
+
+    int GetOrdinal() const {
+        return ordinals_[position_];
+    }
+
+    double GetTermFreq() const {
+        return term_freqs_[position_];
+    }
+
+    void Next() {
+        if (++position_ == block_size_) {
+            LoadBlock(block_ + 1);
+        }
+    }
+
+    // Moves to the first posting with an ordinal not less than the given one, galloping over the last ordinals of the blocks
+    // and then within the block, so the cost grows with the logarithm of the distance
+    void SkipTo(int ordinal);
+
+    // Calls function(ordinal, term_freq) for the remaining postings with ordinals less than the given one and moves past them
+    template <typename Function>
+    void ForEachBefore(int last_ordinal, Function function) {
+        for (; !IsEnd(); LoadBlock(block_ + 1)) {
+            const int block_size = block_size_;
+            for (int i = position_; i < block_size; ++i) {
+                if (ordinals_[i] >= last_ordinal) {
+                    position_ = i;
+                    return;
+                }
+                function(ordinals_[i], term_freqs_[i]);
+            }
+        }
+    }
+
+    template <typename Function>
+    void ForEach(Function function) {
+        ForEachBefore(std::numeric_limits<int>::max(), function);
+    }
+
+    // Like ForEach, but asks stop() before every block; returns false once it stopped with postings left
+    template <typename Function, typename StopPredicate>
+    bool ForEachUntil(Function function, StopPredicate stop) {
+        for (; !IsEnd(); LoadBlock(block_ + 1)) {
+            if (stop()) {
+                return false;
+            }
+            const int block_size = block_size_;
+            for (int i = position_; i < block_size; ++i) {
+                function(ordinals_[i], term_freqs_[i]);
+            }
+        }
+        return true;
+    }
+
+private:
+    friend class IndexSegment;
+
+    const IndexSegment::Storage* storage_ = nullptr;
+    const IndexSegment::PostingList* postings_ = nullptr;
+    size_t first_block_ = 0;
+    size_t block_ = 0;
+    size_t end_block_ = 0;
+    size_t posting_count_ = 0;
+    int block_size_ = 0;
+    int position_ = 0;
+    int ordinals_[POSTING_BLOCK_SIZE];
+    double term_freqs_[POSTING_BLOCK_SIZE];
+
+    int GetBlockLastOrdinal(size_t block) const;
+    size_t FindBlock(size_t block, int ordinal) const;
+    void LoadBlock(size_t block);
+};
+
+template <typename Function>
+void IndexSegment::ForEachTerm(int ordinal, Function function) const {
+    const Storage& storage = *storage_;
+    for (size_t i = storage.document_term_offsets[ordinal]; i < storage.document_term_offsets[ordinal + 1]; ++i) {
+        function(storage.document_terms[i], storage.document_term_counts[i]);
+    }
+}
\ No newline at end of file
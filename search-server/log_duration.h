@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
+#define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
+#define UNIQUE_VAR_NAME_PROFILE PROFILE_CONCAT(profile_guard_, __LINE__)
+#define LOG_DURATION(x) LogDuration UNIQUE_VAR_NAME_PROFILE(x)
+#define LOG_DURATION_STREAM(x, y) LogDuration UNIQUE_VAR_NAME_PROFILE(x, y)
+
+// Writes the time from its construction to its destruction, in milliseconds
+class LogDuration {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit LogDuration(std::string_view id, std::ostream& out = std::cerr)
+        : id_(id)
+        , out_(out) {
+    }
+
+    LogDuration(const LogDuration&) = delete;
+    LogDuration& operator=(const LogDuration&) = delete;
+
+    ~LogDuration() {
+        using namespace std::literals;
+        const Clock::duration duration = Clock::now() - start_time_;
+        out_ << id_ << ": "sv << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() << " ms"sv << std::endl;
+    }
+
+private:
+    const std::string id_;
+    std::ostream& out_;
+    const Clock::time_point start_time_ = Clock::now();
+};
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// A thread-safe map from strings that keeps the capacity most recently used values; a zero capacity disables it
+template <typename Value>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity = 0) : capacity_(capacity) {
+    }
+
+    size_t GetCapacity() const {
+        std::lock_guard lock(mutex_);
+        return capacity_;
+    }
+
+    size_t GetSize() const {
+        std::lock_guard lock(mutex_);
+        return entries_.size();
+    }
+
+    void SetCapacity(size_t capacity) {
+        std::lock_guard lock(mutex_);
+        capacity_ = capacity;
+        Evict();
+    }
+
+    // Marks a found value as the most recently used
+    std::optional<Value> Find(std::string_view key) {
+        std::lock_guard lock(mutex_);
+        const auto position = positions_.find(key);
+        if (position == positions_.end()) {
+            return std::nullopt;
+        }
+        entries_.splice(entries_.begin(), entries_, position->second);
+        return position->second->value;
+    }
+
+    // Replaces the value a key already has
+    void Insert(std::string_view key, Value value) {
+        std::lock_guard lock(mutex_);
+        if (capacity_ == 0) {
+            return;
+        }
+        if (const auto position = positions_.find(key); position != positions_.end()) {
+            position->second->value = std::move(value);
+            entries_.splice(entries_.begin(), entries_, position->second);
+            return;
+        }
+        entries_.push_front({std::string(key), std::move(value)});
+        // List nodes never move, so the key can view the string of its entry
+        positions_.emplace(entries_.front().key, entries_.begin());
+        Evict();
+    }
+
+    void Clear() {
+        std::lock_guard lock(mutex_);
+        positions_.clear();
+        entries_.clear();
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        Value value;
+    };
+
+    size_t capacity_;
+    // From the most recently used
+    std::list<Entry> entries_;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator> positions_;
+    mutable std::mutex mutex_;
+
+    void Evict() {
+        while (entries_.size() > capacity_) {
+            positions_.erase(entries_.back().key);
+            entries_.pop_back();
+        }
+    }
+};
\ No newline at end of file
@@ -1,8 +1,13 @@
 #include <execution>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <string>
 #include <vector>
 
+#include "concurrent_hash_map.h"
+#include "concurrent_map.h"
+#include "corpus_loader.h"
 #include "log_duration.h"
 #include "process_queries.h"
 #include "search_server.h"
@@ -66,6 +71,19 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
 
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
+template <typename Map>
+void TestConcurrentMap(string_view mark, Map& map, const vector<int>& keys) {
+    LOG_DURATION(mark);
+    for_each(execution::par, keys.begin(), keys.end(), [&map](int key) {
+        map[key].ref_to_value += 1.0;
+    });
+    double total = 0;
+    for (const auto& [key, value] : map.BuildOrdinaryMap()) {
+        total += value;
+    }
+    cout << total << endl;
+}
+
 void PrintDocument(const Document& document) {
     cout << "{ "s
          << "document_id = "s << document.id << ", "s
@@ -73,7 +91,38 @@ void PrintDocument(const Document& document) {
          << "rating = "s << document.rating << " }"s << endl;
 }
 
-int main() {
+// Indexes a corpus file, or standard input for "-", streaming it instead of holding it in memory.
+// Files ending in .jsonl are read as JSON lines, everything else as TSV
+int IndexCorpus(const string& path, const string& stop_words) {
+    ios::sync_with_stdio(false);
+    const bool is_jsonl = path.size() >= 6 && path.compare(path.size() - 6, 6, ".jsonl"s) == 0;
+    const CorpusFormat format = is_jsonl ? CorpusFormat::JSONL : CorpusFormat::TSV;
+    SearchServer search_server(stop_words);
+    vector<SearchServer::DocumentError> errors;
+    {
+        LOG_DURATION("LoadCorpus"s);
+        if (path == "-"s) {
+            errors = LoadCorpus(search_server, cin, format);
+        } else {
+            ifstream input(path, ios::binary);
+            if (!input) {
+                cerr << "Cannot open "s << path << endl;
+                return 1;
+            }
+            errors = LoadCorpus(search_server, input, format);
+        }
+    }
+    for (const auto& error : errors) {
+        cerr << "line "s << error.position << ": "s << error.message << endl;
+    }
+    cout << search_server.GetDocumentCount() << " documents indexed"s << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        return IndexCorpus(argv[1], argc > 2 ? argv[2] : ""s);
+    }
     /*{   
         SearchServer search_server("and with"s);
 
@@ -122,6 +171,21 @@ int main() {
 
         TEST(seq);
         TEST(par);
+        if constexpr (QUERY_PROFILING) {
+            cerr << search_server.GetQueryProfile();
+        }
+    }
+    {
+        mt19937 generator;
+        vector<int> keys(1'000'000);
+        for (int& key : keys) {
+            key = uniform_int_distribution(0, 100'000)(generator);
+        }
+
+        ConcurrentMap<int, double> ordered_map(100);
+        ConcurrentHashMap<int, double> hash_map(100);
+        TestConcurrentMap("ConcurrentMap"s, ordered_map, keys);
+        TestConcurrentMap("ConcurrentHashMap"s, hash_map, keys);
     }
     return 0;
 } 
\ No newline at end of file
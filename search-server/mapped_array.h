@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A read-only array that either owns its values or views memory kept alive elsewhere, such as a mapped index file.
+// Copies of a view point to the same memory; values can only be appended to an array that owns them
+template <typename T>
+class MappedArray {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    MappedArray() = default;
+
+    explicit MappedArray(std::vector<T> values)
+        : values_(std::move(values))
+        , data_(values_.data())
+        , size_(values_.size()) {
+    }
+
+    MappedArray(const T* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    MappedArray(const MappedArray& other)
+        : values_(other.values_)
+        , data_(other.IsView() ? other.data_ : values_.data())
+        , size_(other.size_) {
+    }
+
+    MappedArray(MappedArray&& other) noexcept
+        : values_(std::move(other.values_))
+        , data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0)) {
+    }
+
+    MappedArray& operator=(MappedArray other) noexcept {
+        values_.swap(other.values_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    const T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    const T& back() const {
+        return data_[size_ - 1];
+    }
+
+    void push_back(const T& value) {
+        values_.push_back(value);
+        data_ = values_.data();
+        size_ = values_.size();
+    }
+
+private:
+    std::vector<T> values_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+
+    bool IsView() const {
+        return data_ != values_.data();
+    }
+};
\ No newline at end of file
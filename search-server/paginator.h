@@ -2,6 +2,7 @@
 #include "document.h"
 
 #include <iostream>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -37,20 +38,20 @@ std::ostream& operator<<(std::ostream& out, const IteratorRange<Iterator>& page)
 template<typename Iterator>
 class Paginator {
 public:
+    // Forward iterators are enough, though pages of random access ones are found in constant time
     Paginator(Iterator begin, Iterator end, size_t page_size) {
         if(begin == end){
         using namespace std;
             throw invalid_argument("Container documents is empty"s);
-        } else if(distance(begin, end) < page_size) {
-            result_.push_back(IteratorRange(begin, end));
-        } else {
-            auto iterator = begin;
-            while (iterator + page_size < end) {
-                result_.push_back(IteratorRange(iterator, iterator + page_size));
-                iterator += page_size;
-            }
-            result_.push_back(IteratorRange(iterator, end));
         }
+        auto remaining = static_cast<size_t>(std::distance(begin, end));
+        while (remaining > page_size) {
+            const Iterator page_end = std::next(begin, page_size);
+            result_.push_back(IteratorRange(begin, page_end));
+            begin = page_end;
+            remaining -= page_size;
+        }
+        result_.push_back(IteratorRange(begin, end));
     }
     
     auto begin() const {
@@ -71,5 +72,5 @@ private:
 
 template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
-    return Paginator(begin(c), end(c), page_size);
+    return Paginator(std::begin(c), std::end(c), page_size);
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "posting_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int PackBits(const int* values, size_t count, std::vector<uint8_t>& data) {
+    const auto max_value = static_cast<uint32_t>(count == 0 ? 0 : *std::max_element(values, values + count));
+    int bits = 0;
+    while (bits < 32 && (max_value >> bits) != 0) {
+        ++bits;
+    }
+    const size_t offset = data.size();
+    data.resize(offset + GetPackedSize(bits, count), 0);
+    uint8_t* out = data.data() + offset;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t bit_offset = i * bits;
+        uint64_t value = static_cast<uint64_t>(static_cast<uint32_t>(values[i])) << (bit_offset % 8);
+        for (size_t byte = bit_offset / 8; value != 0; ++byte, value >>= 8) {
+            out[byte] |= static_cast<uint8_t>(value);
+        }
+    }
+    return bits;
+}
+
+size_t GetPackedSize(int bits, size_t count) {
+    return (count * bits + 7) / 8;
+}
+
+void UnpackBits(const uint8_t* data, int bits, size_t count, int* values) {
+    if (bits == 0) {
+        std::fill(values, values + count, 0);
+        return;
+    }
+    size_t i = 0;
+#if defined(__AVX2__)
+    // Eight values at a time, each gathered from the four bytes at its first bit; wider values may span five
+    if (bits <= 25) {
+        const __m256i mask = _mm256_set1_epi32(static_cast<int>((uint32_t{1} << bits) - 1));
+        const __m256i seven = _mm256_set1_epi32(7);
+        const __m256i step = _mm256_set1_epi32(8 * bits);
+        __m256i bit_offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(bits));
+        for (; i + 8 <= count; i += 8) {
+            const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data), _mm256_srli_epi32(bit_offsets, 3), 1);
+            const __m256i shifted = _mm256_srlv_epi32(words, _mm256_and_si256(bit_offsets, seven));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), _mm256_and_si256(shifted, mask));
+            bit_offsets = _mm256_add_epi32(bit_offsets, step);
+        }
+    }
+#endif
+    const uint64_t mask = (uint64_t{1} << bits) - 1;
+    for (; i < count; ++i) {
+        const size_t bit_offset = i * bits;
+        uint64_t word;
+        std::memcpy(&word, data + bit_offset / 8, sizeof(word));
+        values[i] = static_cast<int>(word >> (bit_offset % 8) & mask);
+    }
+}
+
+void PrefixSum(int* values, size_t count, int base) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i carry = _mm_set1_epi32(base);
+    for (; i + 4 <= count; i += 4) {
+        __m128i sums = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 4));
+        sums = _mm_add_epi32(sums, _mm_slli_si128(sums, 8));
+        sums = _mm_add_epi32(sums, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), sums);
+        carry = _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    if (i > 0) {
+        base = values[i - 1];
+    }
+#endif
+    for (; i < count; ++i) {
+        base += values[i];
+        values[i] = base;
+    }
+}
\ No newline at end of file
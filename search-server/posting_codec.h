@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t POSTING_BLOCK_SIZE = 128;
+// Unpacking reads up to this many bytes past the packed values, so whatever holds them must have that many more
+const size_t PACKED_DATA_PADDING = 8;
+
+// Appends the values, none of them negative, packed in the fewest bits that fit all of them; returns that bit width
+int PackBits(const int* values, size_t count, std::vector<uint8_t>& data);
+size_t GetPackedSize(int bits, size_t count);
+void UnpackBits(const uint8_t* data, int bits, size_t count, int* values);
+// Turns deltas into running sums starting from base
+void PrefixSum(int* values, size_t count, int base);
\ No newline at end of file
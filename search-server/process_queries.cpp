@@ -1,26 +1,237 @@
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <execution>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <thread>
 
 #include "process_queries.h"
 
+namespace {
+
+struct QueryTask {
+    size_t position;
+    size_t cost;
+};
+
+struct PreparedBatch {
+    std::vector<std::optional<SearchServer::PreparedQuery>> queries;
+    // In query order
+    std::vector<QueryTask> tasks;
+    // A query costing more than the share of one thread would hold up the batch, so it is split across threads instead
+    size_t split_cost = std::numeric_limits<size_t>::max();
+};
+
+PreparedBatch PrepareBatch(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    PreparedBatch batch;
+    batch.queries.resize(queries.size());
+    batch.tasks.resize(queries.size());
+    std::vector<size_t> positions(queries.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    std::for_each(std::execution::par, positions.begin(), positions.end(), [&](const size_t position) {
+        batch.queries[position] = search_server.PrepareQuery(queries[position]);
+        batch.tasks[position] = {position, search_server.EstimateQueryCost(*batch.queries[position])};
+    });
+
+    // Maximum score evaluation is sequential and skips most of the postings the cost counts, so it is never split
+    if (search_server.GetEvaluationMode() == EvaluationMode::EXHAUSTIVE) {
+        const size_t total_cost = std::accumulate(batch.tasks.begin(), batch.tasks.end(), size_t{0}, [](size_t cost, const QueryTask& task) {
+            return cost + task.cost;
+        });
+        batch.split_cost = total_cost / std::max(1u, std::thread::hardware_concurrency());
+    }
+    return batch;
+}
+
+}
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
+    PreparedBatch batch = PrepareBatch(search_server, queries);
+    std::vector<QueryTask>& tasks = batch.tasks;
+
+    // Costly queries start first, so that cheap ones fill in the tail of the batch
+    std::sort(tasks.begin(), tasks.end(), [](const QueryTask& lhs, const QueryTask& rhs) {
+        return lhs.cost > rhs.cost;
+    });
+
+    // Split queries run alongside the others: threads waiting on the parts of one take up other queries meanwhile
     std::vector<std::vector<Document>> result(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(),
-                  [&search_server](const std::string query) {return search_server.FindTopDocuments(query);});
+    std::for_each(std::execution::par, tasks.begin(), tasks.end(), [&](const QueryTask& task) {
+        const SearchServer::PreparedQuery& query = *batch.queries[task.position];
+        result[task.position] = task.cost > batch.split_cost ? search_server.FindTopDocuments(std::execution::par, query)
+                                                             : search_server.FindTopDocuments(query);
+    });
     return result;
 }
 
-std::vector<Document> ProcessQueriesJoined(
+struct JoinedDocuments::State {
+    PreparedBatch batch;
+    // MAX_RESULT_DOCUMENT_COUNT documents for each query
+    std::vector<Document> documents;
+    // One more than the number of documents a query found; zero until it finishes
+    std::unique_ptr<std::atomic<size_t>[]> finished_sizes;
+    std::atomic<size_t> finished_count = 0;
+    mutable std::mutex mutex;
+    mutable std::condition_variable query_finished;
+    // Queries readers wait for, ALL_QUERIES for the whole batch; other queries finish without waking anyone
+    mutable std::vector<size_t> awaited_queries;
+
+    static const size_t ALL_QUERIES = std::numeric_limits<size_t>::max();
+
+    explicit State(PreparedBatch prepared_batch)
+        : batch(std::move(prepared_batch))
+        , documents(batch.queries.size() * MAX_RESULT_DOCUMENT_COUNT)
+        , finished_sizes(std::make_unique<std::atomic<size_t>[]>(batch.queries.size())) {
+    }
+
+    size_t GetQueryCount() const {
+        return batch.queries.size();
+    }
+
+    const Document* GetDocuments(size_t query) const {
+        return documents.data() + query * MAX_RESULT_DOCUMENT_COUNT;
+    }
+
+    void Finish(size_t query, const std::vector<Document>& query_documents) {
+        std::copy(query_documents.begin(), query_documents.end(), documents.begin() + query * MAX_RESULT_DOCUMENT_COUNT);
+        // The lock keeps a reader from missing the notification between its check and its wait
+        std::unique_lock lock(mutex);
+        finished_sizes[query].store(query_documents.size() + 1, std::memory_order_release);
+        const bool is_last = finished_count.fetch_add(1, std::memory_order_release) + 1 == GetQueryCount();
+        const bool is_awaited = std::any_of(awaited_queries.begin(), awaited_queries.end(), [query, is_last](size_t awaited_query) {
+            return awaited_query == query || (awaited_query == ALL_QUERIES && is_last);
+        });
+        lock.unlock();
+        if (is_awaited) {
+            query_finished.notify_all();
+        }
+    }
+
+    size_t WaitForQuery(size_t query) const {
+        size_t finished_size = finished_sizes[query].load(std::memory_order_acquire);
+        if (finished_size == 0) {
+            Wait(query, [&] {
+                finished_size = finished_sizes[query].load(std::memory_order_acquire);
+                return finished_size != 0;
+            });
+        }
+        return finished_size - 1;
+    }
+
+    void WaitForAll() const {
+        if (finished_count.load(std::memory_order_acquire) < GetQueryCount()) {
+            Wait(ALL_QUERIES, [this] {
+                return finished_count.load(std::memory_order_acquire) == GetQueryCount();
+            });
+        }
+    }
+
+    template <typename Predicate>
+    void Wait(size_t query, Predicate predicate) const {
+        std::unique_lock lock(mutex);
+        awaited_queries.push_back(query);
+        query_finished.wait(lock, predicate);
+        awaited_queries.erase(std::find(awaited_queries.begin(), awaited_queries.end(), query));
+    }
+};
+
+JoinedDocuments::JoinedDocuments(const SearchServer& search_server, const std::vector<std::string>& queries)
+    : state_(std::make_unique<State>(PrepareBatch(search_server, queries))) {
+    // Queries run in order, so that the reader rarely waits
+    worker_ = std::thread([state = state_.get(), &search_server] {
+        const PreparedBatch& batch = state->batch;
+        std::for_each(std::execution::par, batch.tasks.begin(), batch.tasks.end(), [&](const QueryTask& task) {
+            const SearchServer::PreparedQuery& query = *batch.queries[task.position];
+            state->Finish(task.position, task.cost > batch.split_cost ? search_server.FindTopDocuments(std::execution::par, query)
+                                                                      : search_server.FindTopDocuments(query));
+        });
+    });
+}
+
+JoinedDocuments::JoinedDocuments(JoinedDocuments&& other) noexcept = default;
+
+JoinedDocuments::~JoinedDocuments() {
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+JoinedDocuments::Iterator JoinedDocuments::begin() const {
+    return Iterator(state_.get(), 0);
+}
+
+JoinedDocuments::Iterator JoinedDocuments::end() const {
+    return Iterator(state_.get(), state_->GetQueryCount());
+}
+
+size_t JoinedDocuments::GetQueryCount() const {
+    return state_->GetQueryCount();
+}
+
+IteratorRange<const Document*> JoinedDocuments::GetQueryDocuments(size_t query) const {
+    const Document* documents = state_->GetDocuments(query);
+    return IteratorRange(documents, documents + state_->WaitForQuery(query));
+}
+
+size_t JoinedDocuments::size() const {
+    state_->WaitForAll();
+    size_t size = 0;
+    for (size_t query = 0; query < state_->GetQueryCount(); ++query) {
+        size += state_->WaitForQuery(query);
+    }
+    return size;
+}
+
+JoinedDocuments::Iterator::Iterator(const State* state, size_t query)
+    : state_(state)
+    , query_(query) {
+    SkipEmptyQueries();
+}
+
+JoinedDocuments::Iterator::reference JoinedDocuments::Iterator::operator*() const {
+    return state_->GetDocuments(query_)[position_];
+}
+
+JoinedDocuments::Iterator::pointer JoinedDocuments::Iterator::operator->() const {
+    return state_->GetDocuments(query_) + position_;
+}
+
+JoinedDocuments::Iterator& JoinedDocuments::Iterator::operator++() {
+    if (++position_ == size_) {
+        position_ = 0;
+        ++query_;
+        SkipEmptyQueries();
+    }
+    return *this;
+}
+
+JoinedDocuments::Iterator JoinedDocuments::Iterator::operator++(int) {
+    Iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool JoinedDocuments::Iterator::operator==(const Iterator& other) const {
+    return query_ == other.query_ && position_ == other.position_;
+}
+
+bool JoinedDocuments::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+void JoinedDocuments::Iterator::SkipEmptyQueries() {
+    while (query_ < state_->GetQueryCount() && (size_ = state_->WaitForQuery(query_)) == 0) {
+        ++query_;
+    }
+}
+
+JoinedDocuments ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    std::vector<std::vector<Document>> contain(queries.size());
-    std::vector<Document> result;
-    std::transform(std::execution::par, queries.begin(), queries.end(), contain.begin(),
-                  [&search_server](const std::string query) {return search_server.FindTopDocuments(query);});
-    for(const auto documents : contain) {
-        result.insert(result.end(), documents.begin(), documents.end());
-    }
-    return result;
+    return JoinedDocuments(search_server, queries);
 }
\ No newline at end of file
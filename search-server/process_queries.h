@@ -1,15 +1,79 @@
 #pragma once
 
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <string>
 
 #include "document.h"
+#include "paginator.h"
 #include "search_server.h"
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries); 
 
-std::vector<Document> ProcessQueriesJoined(
+// Documents found by a batch of queries, in query order. The queries run in the background into one buffer with a
+// region per query, and reading waits only for the query being read, so the first results can be used early.
+// The server must outlive the object
+class JoinedDocuments {
+    struct State;
+
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Document;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Document*;
+        using reference = const Document&;
+
+        reference operator*() const;
+        pointer operator->() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        friend class JoinedDocuments;
+
+        const State* state_;
+        size_t query_;
+        size_t position_ = 0;
+        // Of the query being read
+        size_t size_ = 0;
+
+        Iterator(const State* state, size_t query);
+
+        // Waits for the queries it passes
+        void SkipEmptyQueries();
+    };
+
+    // Queries are parsed before the constructor returns, so the strings need not outlive the object
+    JoinedDocuments(const SearchServer& search_server, const std::vector<std::string>& queries);
+    JoinedDocuments(JoinedDocuments&& other) noexcept;
+    JoinedDocuments& operator=(JoinedDocuments&& other) = delete;
+    // Waits for the running queries
+    ~JoinedDocuments();
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    size_t GetQueryCount() const;
+    // Waits for the query; the range views the buffer
+    IteratorRange<const Document*> GetQueryDocuments(size_t query) const;
+    // Waits for the whole batch
+    size_t size() const;
+
+private:
+    std::unique_ptr<State> state_;
+    std::thread worker_;
+};
+
+JoinedDocuments ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "query_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+using namespace std::string_literals;
+
+namespace {
+
+double ToMicroseconds(QueryTrace::Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
+
+std::string_view GetQueryPhaseName(QueryPhase phase) {
+    switch (phase) {
+        case QueryPhase::PARSE:
+            return "parse";
+        case QueryPhase::POSTINGS:
+            return "postings";
+        case QueryPhase::MINUS_FILTER:
+            return "minus filter";
+        case QueryPhase::RANKING:
+            return "ranking";
+    }
+    return "unknown";
+}
+
+std::string_view GetQueryCounterName(QueryCounter counter) {
+    switch (counter) {
+        case QueryCounter::POSTINGS_SCANNED:
+            return "postings scanned";
+        case QueryCounter::DOCUMENTS_SCORED:
+            return "documents scored";
+        case QueryCounter::ALLOCATIONS:
+            return "allocations";
+    }
+    return "unknown";
+}
+
+void QueryTrace::Merge(const QueryTrace& other) {
+    for (size_t phase = 0; phase < QUERY_PHASE_COUNT; ++phase) {
+        durations_[phase] += other.durations_[phase];
+    }
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        counts_[counter] += other.counts_[counter];
+    }
+}
+
+std::ostream& operator<<(std::ostream& out, const QueryTrace& trace) {
+    out << "total: "s << ToMicroseconds(trace.GetTotalDuration()) << " us"s;
+    for (size_t phase = 0; phase < QUERY_PHASE_COUNT; ++phase) {
+        out << ", "s << GetQueryPhaseName(static_cast<QueryPhase>(phase)) << ": "s
+            << ToMicroseconds(trace.GetDuration(static_cast<QueryPhase>(phase))) << " us"s;
+    }
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        out << ", "s << GetQueryCounterName(static_cast<QueryCounter>(counter)) << ": "s
+            << trace.GetCount(static_cast<QueryCounter>(counter));
+    }
+    return out;
+}
+
+void LatencyHistogram::Add(QueryTrace::Clock::duration duration) {
+    const auto nanoseconds = static_cast<uint64_t>(std::max<int64_t>(std::chrono::nanoseconds(duration).count(), 0));
+    const uint64_t microseconds = nanoseconds / 1000;
+    int bucket = 0;
+    while (bucket + 1 < BUCKET_COUNT && (microseconds >> bucket) != 0) {
+        ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_nanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset() {
+    for (std::atomic<uint64_t>& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    total_nanoseconds_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+QueryTrace::Clock::duration LatencyHistogram::GetTotalDuration() const {
+    return std::chrono::duration_cast<QueryTrace::Clock::duration>(std::chrono::nanoseconds(total_nanoseconds_.load(std::memory_order_relaxed)));
+}
+
+uint64_t LatencyHistogram::GetBucketCount(int bucket) const {
+    return buckets_[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetQuantileBound(double fraction) const {
+    // Buckets are read one by one while others may add to them, so the rank is taken from their own sum
+    std::array<uint64_t, BUCKET_COUNT> counts;
+    uint64_t count = 0;
+    for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        counts[bucket] = GetBucketCount(bucket);
+        count += counts[bucket];
+    }
+    const auto rank = static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * count));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank && seen > 0) {
+            return uint64_t{1} << bucket;
+        }
+    }
+    return 0;
+}
+
+std::ostream& operator<<(std::ostream& out, const LatencyHistogram& histogram) {
+    const uint64_t count = histogram.GetCount();
+    out << "count "s << count;
+    if (count > 0) {
+        out << ", mean "s << ToMicroseconds(histogram.GetTotalDuration()) / count << " us"s
+            << ", p50 < "s << histogram.GetQuantileBound(0.5) << " us"s
+            << ", p90 < "s << histogram.GetQuantileBound(0.9) << " us"s
+            << ", p99 < "s << histogram.GetQuantileBound(0.99) << " us"s;
+    }
+    for (int bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+        if (const uint64_t bucket_count = histogram.GetBucketCount(bucket); bucket_count > 0) {
+            out << "\n  ["s << (bucket == 0 ? 0 : uint64_t{1} << (bucket - 1)) << ", "s << (uint64_t{1} << bucket) << ") us: "s << bucket_count;
+        }
+    }
+    return out;
+}
+
+void QueryProfile::Record(const QueryTrace& trace) {
+    total_.Add(trace.GetTotalDuration());
+    for (size_t phase = 0; phase < QUERY_PHASE_COUNT; ++phase) {
+        phases_[phase].Add(trace.GetDuration(static_cast<QueryPhase>(phase)));
+    }
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        counts_[counter].fetch_add(trace.GetCount(static_cast<QueryCounter>(counter)), std::memory_order_relaxed);
+    }
+}
+
+void QueryProfile::Reset() {
+    total_.Reset();
+    for (LatencyHistogram& histogram : phases_) {
+        histogram.Reset();
+    }
+    for (std::atomic<uint64_t>& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t QueryProfile::GetQueryCount() const {
+    return total_.GetCount();
+}
+
+const LatencyHistogram& QueryProfile::GetTotalHistogram() const {
+    return total_;
+}
+
+const LatencyHistogram& QueryProfile::GetHistogram(QueryPhase phase) const {
+    return phases_[static_cast<size_t>(phase)];
+}
+
+uint64_t QueryProfile::GetCount(QueryCounter counter) const {
+    return counts_[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+std::ostream& operator<<(std::ostream& out, const QueryProfile& profile) {
+    const uint64_t query_count = profile.GetQueryCount();
+    out << "queries: "s << query_count << '\n';
+    out << "total: "s << profile.GetTotalHistogram() << '\n';
+    for (size_t phase = 0; phase < QUERY_PHASE_COUNT; ++phase) {
+        out << GetQueryPhaseName(static_cast<QueryPhase>(phase)) << ": "s << profile.GetHistogram(static_cast<QueryPhase>(phase)) << '\n';
+    }
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        const uint64_t count = profile.GetCount(static_cast<QueryCounter>(counter));
+        out << GetQueryCounterName(static_cast<QueryCounter>(counter)) << ": "s << count;
+        if (query_count > 0) {
+            out << ", "s << static_cast<double>(count) / query_count << " per query"s;
+        }
+        out << '\n';
+    }
+    return out;
+}
+
+#ifdef SEARCH_SERVER_PROFILING
+// Replaces the global allocation functions to count what traced searches allocate. Every form but the aligned ones
+// is replaced, so none of them pairs with a function of the library
+void* operator new(std::size_t size) {
+    CountQueryWork(QueryCounter::ALLOCATIONS, 1);
+    for (;;) {
+        if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+            return pointer;
+        }
+        const std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+#endif
\ No newline at end of file
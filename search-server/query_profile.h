@@ -0,0 +1,313 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+// Searches time their phases and count their work only when built with SEARCH_SERVER_PROFILING defined;
+// otherwise the timers and counters below compile to nothing
+#ifdef SEARCH_SERVER_PROFILING
+inline constexpr bool QUERY_PROFILING = true;
+#else
+inline constexpr bool QUERY_PROFILING = false;
+#endif
+
+enum class QueryPhase {
+    // Splitting the text and looking its words up in the index
+    PARSE,
+    // Scoring the postings of the plus words
+    POSTINGS,
+    // Scanning and probing the postings of the minus words
+    MINUS_FILTER,
+    // Collecting the scored documents into the top
+    RANKING,
+};
+
+enum class QueryCounter {
+    // Loaded into cursors, a block at a time
+    POSTINGS_SCANNED,
+    // Offered to the top with their full relevance; pruned candidates are not
+    DOCUMENTS_SCORED,
+    // Made by the threads of the search while it ran
+    ALLOCATIONS,
+};
+
+inline constexpr size_t QUERY_PHASE_COUNT = 4;
+inline constexpr size_t QUERY_COUNTER_COUNT = 3;
+
+std::string_view GetQueryPhaseName(QueryPhase phase);
+std::string_view GetQueryCounterName(QueryCounter counter);
+
+// Where the time of one search went. The phases of a parallel search add up the time of all its tasks, so they may
+// exceed the total
+class QueryTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration GetTotalDuration() const {
+        return total_duration_;
+    }
+
+    Clock::duration GetDuration(QueryPhase phase) const {
+        return durations_[static_cast<size_t>(phase)];
+    }
+
+    uint64_t GetCount(QueryCounter counter) const {
+        return counts_[static_cast<size_t>(counter)];
+    }
+
+    void SetTotalDuration(Clock::duration duration) {
+        total_duration_ = duration;
+    }
+
+    void AddDuration(QueryPhase phase, Clock::duration duration) {
+        durations_[static_cast<size_t>(phase)] += duration;
+    }
+
+    void AddCount(QueryCounter counter, uint64_t count) {
+        counts_[static_cast<size_t>(counter)] += count;
+    }
+
+    // Adds the phases and counters of the other trace, but not its total
+    void Merge(const QueryTrace& other);
+
+    // The trace the search running on this thread records to, or null
+    static QueryTrace* GetCurrent() {
+        return current_;
+    }
+
+private:
+    friend class QueryTraceScope;
+
+    inline static thread_local QueryTrace* current_ = nullptr;
+
+    Clock::duration total_duration_{};
+    std::array<Clock::duration, QUERY_PHASE_COUNT> durations_{};
+    std::array<uint64_t, QUERY_COUNTER_COUNT> counts_{};
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryTrace& trace);
+
+// Makes the trace current on this thread for its lifetime
+class QueryTraceScope {
+public:
+    explicit QueryTraceScope(QueryTrace& trace)
+        : previous_(QueryTrace::current_) {
+        QueryTrace::current_ = &trace;
+    }
+
+    QueryTraceScope(const QueryTraceScope&) = delete;
+    QueryTraceScope& operator=(const QueryTraceScope&) = delete;
+
+    ~QueryTraceScope() {
+        QueryTrace::current_ = previous_;
+    }
+
+private:
+    QueryTrace* previous_;
+};
+
+// Adds the time it runs to a phase of the current trace; Switch moves it on to another phase
+class QueryPhaseTimer {
+public:
+#ifdef SEARCH_SERVER_PROFILING
+    explicit QueryPhaseTimer(QueryPhase phase)
+        : trace_(QueryTrace::GetCurrent())
+        , phase_(phase) {
+        if (trace_ != nullptr) {
+            start_ = QueryTrace::Clock::now();
+        }
+    }
+
+    QueryPhaseTimer(const QueryPhaseTimer&) = delete;
+    QueryPhaseTimer& operator=(const QueryPhaseTimer&) = delete;
+
+    ~QueryPhaseTimer() {
+        Stop();
+    }
+
+    void Switch(QueryPhase phase) {
+        if (trace_ != nullptr) {
+            const QueryTrace::Clock::time_point now = QueryTrace::Clock::now();
+            trace_->AddDuration(phase_, now - start_);
+            start_ = now;
+        }
+        phase_ = phase;
+    }
+
+    void Stop() {
+        Switch(phase_);
+        trace_ = nullptr;
+    }
+
+private:
+    QueryTrace* trace_;
+    QueryPhase phase_;
+    QueryTrace::Clock::time_point start_;
+#else
+    explicit QueryPhaseTimer(QueryPhase) {
+    }
+
+    void Switch(QueryPhase) {
+    }
+
+    void Stop() {
+    }
+#endif
+};
+
+inline void CountQueryWork([[maybe_unused]] QueryCounter counter, [[maybe_unused]] uint64_t count) {
+#ifdef SEARCH_SERVER_PROFILING
+    if (QueryTrace* trace = QueryTrace::GetCurrent()) {
+        trace->AddCount(counter, count);
+    }
+#endif
+}
+
+// Lets the tasks of a parallel search record into the trace of the thread that started it
+class ParallelQueryTrace {
+public:
+    class Task;
+
+#ifdef SEARCH_SERVER_PROFILING
+    ParallelQueryTrace()
+        : trace_(QueryTrace::GetCurrent()) {
+    }
+
+private:
+    QueryTrace* trace_;
+    std::mutex mutex_;
+#endif
+};
+
+// Records a task into a trace of its own, added to the trace of the search when the task ends
+class ParallelQueryTrace::Task {
+public:
+#ifdef SEARCH_SERVER_PROFILING
+    explicit Task(ParallelQueryTrace& parallel_trace)
+        : parallel_trace_(parallel_trace) {
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (parallel_trace_.trace_ != nullptr) {
+            std::lock_guard lock(parallel_trace_.mutex_);
+            parallel_trace_.trace_->Merge(trace_);
+        }
+    }
+
+private:
+    ParallelQueryTrace& parallel_trace_;
+    QueryTrace trace_;
+    QueryTraceScope scope_{trace_};
+#else
+    explicit Task(ParallelQueryTrace&) {
+    }
+#endif
+};
+
+// Counts durations in buckets of powers of two microseconds; safe to add to from any thread
+class LatencyHistogram {
+public:
+    // The last bucket also takes everything longer
+    static const int BUCKET_COUNT = 32;
+
+    void Add(QueryTrace::Clock::duration duration);
+    void Reset();
+
+    uint64_t GetCount() const;
+    QueryTrace::Clock::duration GetTotalDuration() const;
+    // Bucket 0 holds durations under a microsecond, bucket i those in [2^(i-1), 2^i) microseconds
+    uint64_t GetBucketCount(int bucket) const;
+    // The upper bound of the bucket that takes the durations up to the given fraction of all, in microseconds
+    uint64_t GetQuantileBound(double fraction) const;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> total_nanoseconds_ = 0;
+};
+
+std::ostream& operator<<(std::ostream& out, const LatencyHistogram& histogram);
+
+// Distributions of the total and phase times and the counters over all traced searches; printed as text
+class QueryProfile {
+public:
+    class Scope;
+
+    void Record(const QueryTrace& trace);
+    void Reset();
+
+    uint64_t GetQueryCount() const;
+    const LatencyHistogram& GetTotalHistogram() const;
+    const LatencyHistogram& GetHistogram(QueryPhase phase) const;
+    uint64_t GetCount(QueryCounter counter) const;
+
+private:
+    LatencyHistogram total_;
+    std::array<LatencyHistogram, QUERY_PHASE_COUNT> phases_;
+    std::array<std::atomic<uint64_t>, QUERY_COUNTER_COUNT> counts_{};
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryProfile& profile);
+
+// Traces the search on this thread for its lifetime and then records it in the profile. A search started within
+// another belongs to the outer one and records nothing of its own
+class QueryProfile::Scope {
+public:
+#ifdef SEARCH_SERVER_PROFILING
+    explicit Scope(QueryProfile& profile)
+        : Scope(profile, own_trace_) {
+    }
+
+    Scope(QueryProfile& profile, QueryTrace& trace)
+        : trace_(&trace)
+        , start_(QueryTrace::Clock::now()) {
+        if (QueryTrace::GetCurrent() == nullptr) {
+            profile_ = &profile;
+            installed_.emplace(trace);
+        }
+    }
+#else
+    explicit Scope(QueryProfile&) {
+    }
+
+    // Times the search into the trace even when profiling is not compiled in
+    Scope(QueryProfile&, QueryTrace& trace)
+        : trace_(&trace)
+        , start_(QueryTrace::Clock::now()) {
+    }
+#endif
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+        if (trace_ == nullptr) {
+            return;
+        }
+        trace_->SetTotalDuration(QueryTrace::Clock::now() - start_);
+#ifdef SEARCH_SERVER_PROFILING
+        if (profile_ != nullptr) {
+            installed_.reset();
+            profile_->Record(*trace_);
+        }
+#endif
+    }
+
+private:
+#ifdef SEARCH_SERVER_PROFILING
+    QueryTrace own_trace_;
+    QueryProfile* profile_ = nullptr;
+    std::optional<QueryTraceScope> installed_;
+#endif
+    QueryTrace* trace_ = nullptr;
+    QueryTrace::Clock::time_point start_;
+};
\ No newline at end of file
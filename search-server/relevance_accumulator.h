@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+class RelevanceAccumulator {
+public:
+    void Reset(size_t document_count) {
+        for (const int ordinal : touched_) {
+            relevances_[ordinal] = 0.0;
+            states_[ordinal] = State::UNTOUCHED;
+        }
+        touched_.clear();
+        if (relevances_.size() < document_count) {
+            relevances_.resize(document_count, 0.0);
+            states_.resize(document_count, State::UNTOUCHED);
+        }
+    }
+
+    void Exclude(int ordinal) {
+        if (states_[ordinal] == State::UNTOUCHED) {
+            touched_.push_back(ordinal);
+        }
+        states_[ordinal] = State::EXCLUDED;
+    }
+
+    bool IsExcluded(int ordinal) const {
+        return states_[ordinal] == State::EXCLUDED;
+    }
+
+    void Add(int ordinal, double relevance) {
+        if (states_[ordinal] == State::UNTOUCHED) {
+            states_[ordinal] = State::SCORED;
+            touched_.push_back(ordinal);
+        }
+        relevances_[ordinal] += relevance;
+    }
+
+    template <typename Function>
+    void ForEachScored(Function function) const {
+        for (const int ordinal : touched_) {
+            if (states_[ordinal] == State::SCORED) {
+                function(ordinal, relevances_[ordinal]);
+            }
+        }
+    }
+
+private:
+    enum class State : char {
+        UNTOUCHED,
+        SCORED,
+        EXCLUDED,
+    };
+
+    std::vector<double> relevances_;
+    std::vector<State> states_;
+    std::vector<int> touched_;
+};
\ No newline at end of file
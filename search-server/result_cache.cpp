@@ -0,0 +1,50 @@
+#include "result_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+ResultCache::ResultCache(size_t shard_count)
+    : shard_count_(std::max<size_t>(shard_count, 1))
+    , shards_(std::make_unique<LruCache<Entry>[]>(shard_count_)) {
+}
+
+void ResultCache::SetCapacity(size_t capacity) {
+    capacity_ = capacity;
+    for (size_t shard = 0; shard < shard_count_; ++shard) {
+        shards_[shard].SetCapacity(capacity / shard_count_ + (shard < capacity % shard_count_ ? 1 : 0));
+    }
+}
+
+size_t ResultCache::GetCapacity() const {
+    return capacity_;
+}
+
+std::optional<std::vector<Document>> ResultCache::Find(std::string_view key, uint64_t generation) {
+    // A stale entry is a miss; the search that follows replaces it
+    std::optional<Entry> entry = GetShard(key).Find(key);
+    if (!entry || entry->generation != generation) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return std::move(entry->documents);
+}
+
+void ResultCache::Insert(std::string_view key, uint64_t generation, std::vector<Document> documents) {
+    GetShard(key).Insert(key, {generation, std::move(documents)});
+}
+
+ResultCache::Stats ResultCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    for (size_t shard = 0; shard < shard_count_; ++shard) {
+        stats.size += shards_[shard].GetSize();
+    }
+    return stats;
+}
+
+LruCache<ResultCache::Entry>& ResultCache::GetShard(std::string_view key) const {
+    return shards_[std::hash<std::string_view>{}(key) % shard_count_];
+}
\ No newline at end of file
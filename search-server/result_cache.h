@@ -0,0 +1,46 @@
+#pragma once
+#include "document.h"
+#include "lru_cache.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Results of recent searches in shards locked apart, so concurrent searches rarely wait for each other. An entry only
+// answers searches of the index generation it was computed in
+class ResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t size = 0;
+    };
+
+    explicit ResultCache(size_t shard_count = 16);
+
+    // Spread over the shards; zero, the default, disables the cache and drops what it holds
+    void SetCapacity(size_t capacity);
+    size_t GetCapacity() const;
+
+    std::optional<std::vector<Document>> Find(std::string_view key, uint64_t generation);
+    void Insert(std::string_view key, uint64_t generation, std::vector<Document> documents);
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    size_t shard_count_;
+    std::unique_ptr<LruCache<Entry>[]> shards_;
+    std::atomic<size_t> capacity_ = 0;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+
+    LruCache<Entry>& GetShard(std::string_view key) const;
+};
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Copies share the flag, so the caller keeps one to cancel the searches it gave the others to
+class CancellationToken {
+public:
+    void Cancel() {
+        cancelled_->store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_->load(std::memory_order_relaxed);
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_ = std::make_shared<std::atomic<bool>>(false);
+};
+
+// Tells a search to stop once the time is up or its token is cancelled; the default one never expires
+class SearchDeadline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    SearchDeadline() = default;
+
+    explicit SearchDeadline(Clock::time_point deadline, std::optional<CancellationToken> token = std::nullopt)
+        : deadline_(deadline)
+        , token_(std::move(token)) {
+    }
+
+    explicit SearchDeadline(CancellationToken token)
+        : token_(std::move(token)) {
+    }
+
+    static SearchDeadline After(Clock::duration timeout, std::optional<CancellationToken> token = std::nullopt) {
+        return SearchDeadline(Clock::now() + timeout, std::move(token));
+    }
+
+    // Reads the clock only for a deadline that was set
+    bool IsExpired() const {
+        return (token_ && token_->IsCancelled()) || (deadline_ != Clock::time_point::max() && Clock::now() >= deadline_);
+    }
+
+private:
+    Clock::time_point deadline_ = Clock::time_point::max();
+    std::optional<CancellationToken> token_;
+};
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <cmath>
 #include <numeric>
 #include <list>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 using namespace std::string_literals;
@@ -17,58 +19,439 @@ SearchServer::SearchServer(std::string_view stop_words_text)
 }
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    std::lock_guard writer_lock(writer_mutex_);
+    const auto lock = LockReadersForUpdate();
+    IndexVersion& version = *draft_;
+    if ((document_id < 0) || version.FindDocument(document_id)) {
         throw std::invalid_argument("Document id exists or is negative"s);
     }
-    const std::vector<std::string> words = SplitIntoWordsNoStop(document);
-    const double inv_word_count = 1.0 / words.size();
-    for (const std::string& word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+    std::vector<std::string_view>& words = GetThreadWords();
+    words.clear();
+    SplitIntoWordsNoStop(document, words);
+    std::map<TermId, int> term_counts;
+    for (const std::string_view word : words) {
+        ++term_counts[version.dictionary.AddTerm(word)];
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
-    document_ids_.push_back(document_id);
+    for (const auto [term_id, count] : term_counts) {
+        version.dictionary.IncrementDocumentFreq(term_id);
+    }
+    version.AddToBuffer({document_id, ComputeAverageRating(ratings), status}, {term_counts.begin(), term_counts.end()});
+}
+
+std::vector<SearchServer::DocumentError> SearchServer::AddDocuments(const std::vector<DocumentInput>& documents) {
+    struct ParsedDocument {
+        std::vector<std::string_view> words;
+        std::vector<int> term_counts;
+        std::vector<TermId> term_ids;
+        std::string error;
+        int ordinal = -1;
+    };
+
+    std::lock_guard writer_lock(writer_mutex_);
+    const auto lock = LockReadersForUpdate();
+    IndexVersion& version = *draft_;
+    std::vector<ParsedDocument> parsed_documents(documents.size());
+    std::vector<size_t> positions(documents.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    std::for_each(std::execution::par, positions.begin(), positions.end(), [this, &documents, &parsed_documents](const size_t position) {
+        ParsedDocument& parsed = parsed_documents[position];
+        std::vector<std::string_view>& words = GetThreadWords();
+        words.clear();
+        try {
+            SplitIntoWordsNoStop(documents[position].text, words);
+        } catch (const std::invalid_argument& error) {
+            parsed.error = error.what();
+            return;
+        }
+        std::unordered_map<std::string_view, size_t> word_positions;
+        for (const std::string_view word : words) {
+            const auto [iterator, inserted] = word_positions.emplace(word, parsed.words.size());
+            if (inserted) {
+                parsed.words.push_back(word);
+                parsed.term_counts.push_back(0);
+            }
+            ++parsed.term_counts[iterator->second];
+        }
+    });
+
+    std::vector<DocumentError> errors;
+    std::vector<size_t> accepted;
+    std::unordered_set<int> batch_ids;
+    for (size_t position = 0; position < documents.size(); ++position) {
+        const int document_id = documents[position].id;
+        ParsedDocument& parsed = parsed_documents[position];
+        if (document_id < 0 || version.FindDocument(document_id) || batch_ids.count(document_id) > 0) {
+            errors.push_back({position, document_id, "Document id exists or is negative"s});
+            continue;
+        }
+        if (!parsed.error.empty()) {
+            errors.push_back({position, document_id, std::move(parsed.error)});
+            continue;
+        }
+        batch_ids.insert(document_id);
+        parsed.ordinal = static_cast<int>(accepted.size());
+        parsed.term_ids.reserve(parsed.words.size());
+        for (const std::string_view word : parsed.words) {
+            const TermId term_id = version.dictionary.AddTerm(word);
+            version.dictionary.IncrementDocumentFreq(term_id);
+            parsed.term_ids.push_back(term_id);
+        }
+        accepted.push_back(position);
+    }
+
+    const int accepted_count = static_cast<int>(accepted.size());
+    // A batch smaller than a segment goes to the buffer like single documents
+    if (accepted_count < segment_size_) {
+        for (const size_t position : accepted) {
+            const ParsedDocument& parsed = parsed_documents[position];
+            const DocumentInput& document = documents[position];
+            std::vector<std::pair<TermId, int>> term_counts;
+            term_counts.reserve(parsed.term_ids.size());
+            for (size_t i = 0; i < parsed.term_ids.size(); ++i) {
+                term_counts.push_back({parsed.term_ids[i], parsed.term_counts[i]});
+            }
+            version.AddToBuffer({document.id, ComputeAverageRating(document.ratings), document.status}, term_counts);
+        }
+        return errors;
+    }
+
+    const int part_count = std::max(1, std::min(accepted_count / min_batch_part_size_,
+                                                static_cast<int>(std::thread::hardware_concurrency()) * parts_per_thread_));
+    std::vector<int> parts(part_count);
+    std::iota(parts.begin(), parts.end(), 0);
+
+    std::vector<DocumentData> document_data(accepted.size());
+    std::vector<std::vector<IndexSegment::Posting>> part_postings(part_count);
+    std::for_each(std::execution::par, parts.begin(), parts.end(), [&](const int part) {
+        const int first = static_cast<int>(static_cast<int64_t>(accepted_count) * part / part_count);
+        const int last = static_cast<int>(static_cast<int64_t>(accepted_count) * (part + 1) / part_count);
+        std::vector<IndexSegment::Posting>& postings = part_postings[part];
+        for (int i = first; i < last; ++i) {
+            const DocumentInput& document = documents[accepted[i]];
+            const ParsedDocument& parsed = parsed_documents[accepted[i]];
+            document_data[i] = {document.id, ComputeAverageRating(document.ratings), document.status};
+            for (size_t j = 0; j < parsed.term_ids.size(); ++j) {
+                postings.push_back({parsed.term_ids[j], parsed.ordinal, parsed.term_counts[j]});
+            }
+        }
+        std::sort(postings.begin(), postings.end(), [](const IndexSegment::Posting& lhs, const IndexSegment::Posting& rhs) {
+            return std::tie(lhs.term_id, lhs.ordinal) < std::tie(rhs.term_id, rhs.ordinal);
+        });
+    });
+
+    version.AddSegment(IndexSegment::Build(std::move(document_data), part_postings, version.dictionary.GetTermCount()));
+    return errors;
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus document_status, size_t top_count) const {
+    return SearchServer::FindTopDocuments(std::execution::seq, raw_query, document_status, top_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentStatus document_status, size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return FindCachedTopDocuments(view, policy, query->data_->query, document_status, top_count);
+    }
+    return FindCachedTopDocuments(view, policy, ParseQuery(*view.version, raw_query), document_status, top_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentStatus document_status, size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return FindCachedTopDocuments(view, policy, query->data_->query, document_status, top_count);
+    }
+    return FindCachedTopDocuments(view, policy, ParseQuery(*view.version, raw_query), document_status, top_count);
+}
+
+SearchServer::SearchResult SearchServer::FindTopDocuments(const SearchDeadline& deadline, std::string_view raw_query, DocumentStatus document_status,
+                                                          size_t top_count) const {
+    return SearchServer::FindTopDocuments(deadline, raw_query, [document_status](int document_id, DocumentStatus status, int rating) { return status == document_status;}, top_count);
+}
+
+std::future<SearchServer::SearchResult> SearchServer::FindTopDocumentsAsync(SearchDeadline deadline, std::string raw_query, DocumentStatus document_status,
+                                                                            size_t top_count) const {
+    return SearchServer::FindTopDocumentsAsync(std::move(deadline), std::move(raw_query), [document_status](int document_id, DocumentStatus status, int rating) { return status == document_status;}, top_count);
+}
+
+SearchServer::SearchResult SearchServer::TraceTopDocuments(std::string_view raw_query, DocumentStatus document_status, size_t top_count) const {
+    SearchResult result;
+    result.trace.emplace();
+    {
+        const QueryProfile::Scope profile_scope(query_profile_, *result.trace);
+        result.documents = FindTopDocuments(std::execution::seq, raw_query, document_status, top_count);
+    }
+    return result;
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus document_status, size_t top_count) const {
+    return SearchServer::FindTopDocuments(std::execution::seq, query, document_status, top_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, const PreparedQuery& query, DocumentStatus document_status, size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    return FindCachedTopDocuments(AcquireReadView(), policy, query.data_->query, document_status, top_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy, const PreparedQuery& query, DocumentStatus document_status, size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    return FindCachedTopDocuments(AcquireReadView(), policy, query.data_->query, document_status, top_count);
+}
+
+SearchServer::PreparedQuery::PreparedQuery(std::shared_ptr<const Data> data)
+    : data_(std::move(data)) {
+}
+
+const std::string& SearchServer::PreparedQuery::GetText() const {
+    return data_->text;
+}
+
+SearchServer::PreparedQuery SearchServer::PrepareQuery(std::string_view raw_query) const {
+    const ReadView view = AcquireReadView();
+    if (std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return std::move(*query);
+    }
+    return PrepareQuery(*view.version, raw_query);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindCachedTopDocuments(const ReadView& view, const ExecutionPolicy& policy, const Query& query,
+                                                           DocumentStatus document_status, size_t top_count) const {
+    const auto document_predicate = [document_status](int document_id, DocumentStatus status, int rating) {
+        return status == document_status;
+    };
+    if (result_cache_.GetCapacity() == 0) {
+        return FindTopDocuments(view, policy, query, document_predicate, top_count);
+    }
+    // Evaluations may order documents of equal relevance differently, so each keeps its own results
+    char evaluation = 'p';
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+        evaluation = view.evaluation_mode == EvaluationMode::MAX_SCORE ? 'm' : 's';
+    }
+    const std::string key = MakeResultKey(query, evaluation, document_status, top_count);
+    if (std::optional<std::vector<Document>> documents = result_cache_.Find(key, view.version->generation)) {
+        return std::move(*documents);
+    }
+    std::vector<Document> documents = FindTopDocuments(view, policy, query, document_predicate, top_count);
+    result_cache_.Insert(key, view.version->generation, documents);
+    return documents;
+}
+
+std::string SearchServer::MakeResultKey(const Query& query, char evaluation, DocumentStatus document_status, size_t top_count) {
+    // Words are sorted, unique and free of spaces, so equivalent queries get the same key
+    std::string key{evaluation, static_cast<char>('0' + static_cast<int>(document_status))};
+    key += std::to_string(top_count);
+    for (const std::string_view word : query.plus_words) {
+        key += ' ';
+        key += word;
+    }
+    for (const std::string_view word : query.minus_words) {
+        key += " -"s;
+        key += word;
+    }
+    return key;
+}
+
+size_t SearchServer::EstimateQueryCost(const PreparedQuery& query) const {
+    const ReadView view = AcquireReadView();
+    const IndexVersion& version = *view.version;
+    const Query& parsed = query.data_->query;
+    size_t cost = 0;
+    for (size_t i = 0; i < parsed.plus_terms.size(); ++i) {
+        cost += version.dictionary.GetDocumentFreq(version.ResolveTerm(parsed.plus_terms[i], parsed.plus_words[i], parsed.term_count));
+    }
+    for (size_t i = 0; i < parsed.minus_terms.size(); ++i) {
+        cost += version.dictionary.GetDocumentFreq(version.ResolveTerm(parsed.minus_terms[i], parsed.minus_words[i], parsed.term_count));
+    }
+    return cost;
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    result_cache_.SetCapacity(capacity);
+}
+
+ResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_.GetStats();
+}
+
+const QueryProfile& SearchServer::GetQueryProfile() const {
+    return query_profile_;
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus document_status) const {
-    return SearchServer::FindTopDocuments(std::execution::seq, raw_query, [document_status](int document_id, DocumentStatus status, int rating) { return status == document_status;});
+void SearchServer::ResetQueryProfile() {
+    query_profile_.Reset();
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentStatus document_status) const {
-    return SearchServer::FindTopDocuments(policy, raw_query, [document_status](int document_id, DocumentStatus status, int rating) { return status == document_status;});
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+    query_cache_.SetCapacity(capacity);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentStatus document_status) const {
-    return SearchServer::FindTopDocuments(policy, raw_query, [document_status](int document_id, DocumentStatus status, int rating) { return status == document_status;});
+size_t SearchServer::GetQueryCacheCapacity() const {
+    return query_cache_.GetCapacity();
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return AcquireReadView().version->document_count;
+}
+
+void SearchServer::SetEvaluationMode(EvaluationMode mode) {
+    std::unique_lock lock(mutex_);
+    evaluation_mode_ = mode;
+}
+
+EvaluationMode SearchServer::GetEvaluationMode() const {
+    std::shared_lock lock(mutex_);
+    return evaluation_mode_;
+}
+
+void SearchServer::SetUpdateMode(UpdateMode mode) {
+    std::lock_guard writer_lock(writer_mutex_);
+    if (mode == update_mode_) {
+        return;
+    }
+    // Only writers change the draft, so it is copied without blocking readers, who may be reading it. The replaced
+    // version is freed by its last reader
+    std::shared_ptr<const IndexVersion> version = mode == UpdateMode::SNAPSHOT ? std::make_shared<const IndexVersion>(*draft_) : draft_;
+    std::unique_lock lock(mutex_);
+    std::lock_guard cache_lock(word_freq_cache_.mutex);
+    if (mode == UpdateMode::IMMEDIATE) {
+        RetireWordFrequencies(*published_);
+    }
+    published_.swap(version);
+    update_mode_ = mode;
+}
+
+UpdateMode SearchServer::GetUpdateMode() const {
+    std::shared_lock lock(mutex_);
+    return update_mode_;
+}
+
+void SearchServer::PublishSnapshot() {
+    std::lock_guard writer_lock(writer_mutex_);
+    if (update_mode_ == UpdateMode::IMMEDIATE) {
+        return;
+    }
+    draft_->CompactRemoved();
+    draft_->FreezeBuffer();
+    // The copy is made without blocking readers; the replaced version is freed by its last reader
+    std::shared_ptr<const IndexVersion> version = std::make_shared<const IndexVersion>(*draft_);
+    std::unique_lock lock(mutex_);
+    std::lock_guard cache_lock(word_freq_cache_.mutex);
+    RetireWordFrequencies(*published_);
+    published_.swap(version);
+}
+
+SearchServer::DocumentIdIterator::DocumentIdIterator(std::shared_ptr<const IndexVersion> version)
+    : version_(std::move(version)) {
+    SkipRemoved();
+}
+
+SearchServer::DocumentIdIterator::reference SearchServer::DocumentIdIterator::operator*() const {
+    return version_->segments[segment_].data.GetDocument(ordinal_).id;
+}
+
+SearchServer::DocumentIdIterator& SearchServer::DocumentIdIterator::operator++() {
+    ++ordinal_;
+    SkipRemoved();
+    return *this;
+}
+
+SearchServer::DocumentIdIterator SearchServer::DocumentIdIterator::operator++(int) {
+    DocumentIdIterator result = *this;
+    ++*this;
+    return result;
+}
+
+bool SearchServer::DocumentIdIterator::operator==(const DocumentIdIterator& other) const {
+    if (IsEnd() || other.IsEnd()) {
+        return IsEnd() == other.IsEnd();
+    }
+    return version_ == other.version_ && segment_ == other.segment_ && ordinal_ == other.ordinal_;
+}
+
+bool SearchServer::DocumentIdIterator::operator!=(const DocumentIdIterator& other) const {
+    return !(*this == other);
+}
+
+bool SearchServer::DocumentIdIterator::IsEnd() const {
+    return version_ == nullptr || segment_ >= version_->segments.size();
+}
+
+void SearchServer::DocumentIdIterator::SkipRemoved() {
+    while (!IsEnd()) {
+        const IndexVersion::Segment& segment = version_->segments[segment_];
+        if (ordinal_ >= segment.data.GetDocumentCount()) {
+            ++segment_;
+            ordinal_ = 0;
+        } else if (segment.IsRemoved(ordinal_)) {
+            ++ordinal_;
+        } else {
+            break;
+        }
+    }
+}
+
+SearchServer::DocumentIdIterator SearchServer::begin() const {
+    return DocumentIdIterator(AcquireReadView().version);
+}
+
+SearchServer::DocumentIdIterator SearchServer::end() const {
+    return DocumentIdIterator(nullptr);
 }
 
 const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
     static std::map<std::string_view, double> word_frequencies;
-    if(document_to_word_freqs_.find(document_id) == document_to_word_freqs_.end()) {
+    // Held even in snapshot mode, so the cache is only ever filled from the published version; publication waits at
+    // most for one document to be counted
+    std::shared_lock lock(mutex_);
+    const IndexVersion& version = *published_;
+    const auto location = version.FindDocument(document_id);
+    if(!location) {
         return word_frequencies;
     }
-    return document_to_word_freqs_.at(document_id);
+    std::lock_guard cache_lock(word_freq_cache_.mutex);
+    std::shared_ptr<const WordFrequencies>& word_freqs = word_freq_cache_.word_freqs[document_id];
+    if (word_freqs == nullptr) {
+        const IndexSegment& segment = version.segments[location->segment].data;
+        word_freqs = std::make_shared<const WordFrequencies>(segment.ComputeWordFrequencies(location->ordinal, version.dictionary));
+    }
+    return *word_freqs;
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-    std::vector<std::string_view> key_to_delete;
-    auto iterator = std::find(document_ids_.begin(), document_ids_.end(), document_id);
-    if(iterator == document_ids_.end()) {
+void SearchServer::DropWordFrequencies(int document_id) {
+    if (update_mode_ == UpdateMode::SNAPSHOT) {
+        unpublished_removals_.push_back(document_id);
         return;
     }
-    document_ids_.erase(iterator);
-    documents_.erase(document_id);
-    for (auto& [key, value] : GetWordFrequencies(document_id)) {
-        key_to_delete.push_back(key);
+    std::lock_guard lock(word_freq_cache_.mutex);
+    word_freq_cache_.word_freqs.erase(document_id);
+}
+
+void SearchServer::RetireWordFrequencies(const IndexVersion& replaced_version) {
+    for (const int document_id : unpublished_removals_) {
+        const auto iterator = word_freq_cache_.word_freqs.find(document_id);
+        if (iterator != word_freq_cache_.word_freqs.end()) {
+            replaced_version.retired_word_freqs.push_back(std::move(iterator->second));
+            word_freq_cache_.word_freqs.erase(iterator);
+        }
     }
-    for(const auto key : key_to_delete) {
-        word_to_document_freqs_[static_cast<std::string>(key)].erase(document_id);
+    unpublished_removals_.clear();
+}
+
+void SearchServer::RemoveDocument(int document_id) {
+    std::lock_guard writer_lock(writer_mutex_);
+    const auto lock = LockReadersForUpdate();
+    IndexVersion& version = *draft_;
+    const auto location = version.FindDocument(document_id);
+    if(!location) {
+        return;
     }
-    document_to_word_freqs_.erase(document_id);
+    version.segments[location->segment].data.ForEachTerm(location->ordinal, [&version](TermId term_id, int count) {
+        version.dictionary.DecrementDocumentFreq(term_id);
+    });
+    version.MarkRemoved(*location);
+    DropWordFrequencies(document_id);
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy& policy, int document_id) {
@@ -76,44 +459,94 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy& policy
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy& policy, int document_id) {
-    auto iterator = std::find(document_ids_.begin(), document_ids_.end(), document_id);
-    if(iterator == document_ids_.end()) {
+    std::lock_guard writer_lock(writer_mutex_);
+    const auto lock = LockReadersForUpdate();
+    IndexVersion& version = *draft_;
+    const auto location = version.FindDocument(document_id);
+    if(!location) {
         return;
     }
-    document_ids_.erase(iterator);
-    documents_.erase(document_id);
-    const std::map<std::string_view, double>& word_freqs = GetWordFrequencies(document_id);
-    std::vector<std::string_view> key_to_delete(word_freqs.size());
-    transform(std::execution::par, word_freqs.begin(), word_freqs.end(), key_to_delete.begin(),
-             [](auto word_freq) { return word_freq.first;});
-    for_each(std::execution::par, key_to_delete.begin(), key_to_delete.end(),
-             [this, &document_id](auto str)
-             { word_to_document_freqs_[static_cast<std::string>(str)].erase(document_id);});
-    document_to_word_freqs_.erase(document_id);
+    std::vector<TermId> term_ids;
+    version.segments[location->segment].data.ForEachTerm(location->ordinal, [&term_ids](TermId term_id, int count) {
+        term_ids.push_back(term_id);
+    });
+    for_each(std::execution::par, term_ids.begin(), term_ids.end(),
+             [&version](const TermId term_id)
+             { version.dictionary.DecrementDocumentFreq(term_id);});
+    version.MarkRemoved(*location);
+    DropWordFrequencies(document_id);
 }
 
-SearchServer::TupleType SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
-    const Query query = ParseQuery(raw_query);
-    std::vector<std::string_view> matched_words;
-    for (const auto word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+void SearchServer::CompactIndex() {
+    std::lock_guard writer_lock(writer_mutex_);
+    const auto lock = LockReadersForUpdate();
+    draft_->Compact();
+}
+
+void SearchServer::CompactRemovedDocuments() {
+    std::lock_guard writer_lock(writer_mutex_);
+    const auto lock = LockReadersForUpdate();
+    draft_->CompactRemoved();
+}
+
+void SearchServer::SaveIndex(const std::string& path) const {
+    const ReadView view = AcquireReadView();
+    const IndexVersion& version = *view.version;
+    // The buffer and segments with removed documents are rewritten as sealed segments of their live documents
+    std::vector<IndexSegment> segments;
+    for (const IndexVersion::Segment& segment : version.segments) {
+        if (segment.removed_count == 0 && segment.data.IsSealed()) {
+            segments.push_back(segment.data);
             continue;
         }
-        if (word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id)) {
-            return {{}, documents_.at(document_id).status};
+        IndexSegment merged = IndexSegment::Merge({&segment.data}, {segment.tombstones.get()}, version.dictionary.GetTermCount());
+        if (merged.GetDocumentCount() > 0) {
+            segments.push_back(std::move(merged));
         }
     }
-    
-    for (const auto word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id)) {
-            matched_words.push_back(word);
-        }
+
+    IndexFileWriter writer(path);
+    writer.WriteValue<uint64_t>(stop_words_.GetSize());
+    for (const std::string_view word : stop_words_.GetWords()) {
+        writer.WriteString(word);
+    }
+    version.dictionary.Save(writer);
+    writer.WriteValue<uint64_t>(segments.size());
+    for (const IndexSegment& segment : segments) {
+        segment.Save(writer);
     }
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadIndex(const std::string& path) {
+    IndexFileReader reader(path);
+    return SearchServer(reader);
+}
 
-    return {matched_words, documents_.at(document_id).status};
+SearchServer::SearchServer(IndexFileReader& reader)
+    : draft_(std::make_shared<IndexVersion>())
+    , published_(draft_) {
+    std::vector<std::string_view> stop_words(reader.ReadValue<uint64_t>());
+    for (std::string_view& word : stop_words) {
+        word = reader.ReadString();
+    }
+    stop_words_ = StopWordSet(std::move(stop_words));
+    IndexVersion& version = *draft_;
+    version.dictionary = TermDictionary::Load(reader);
+    const uint64_t segment_count = reader.ReadValue<uint64_t>();
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        IndexSegment segment = IndexSegment::Load(reader);
+        version.document_count += segment.GetDocumentCount();
+        version.segments.insert(version.segments.end() - 1, IndexVersion::Segment(std::move(segment)));
+    }
+}
+
+SearchServer::TupleType SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return MatchQuery(*view.version, query->data_->query, document_id);
+    }
+    return MatchQuery(*view.version, ParseQuery(*view.version, raw_query), document_id);
 }
 
 SearchServer::TupleType SearchServer::MatchDocument(const std::execution::sequenced_policy& policy, 
@@ -123,32 +556,89 @@ SearchServer::TupleType SearchServer::MatchDocument(const std::execution::sequen
 
 SearchServer::TupleType SearchServer::MatchDocument(const std::execution::parallel_policy& policy,
         const std::string_view raw_query, int document_id) const {
-    using namespace std::string_literals;
-    const Query query = ParseQuery(raw_query, false);
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return MatchQuery(policy, *view.version, query->data_->query, document_id);
+    }
+    return MatchQuery(policy, *view.version, ParseQuery(*view.version, raw_query, false), document_id);
+}
+
+SearchServer::TupleType SearchServer::MatchDocument(const PreparedQuery& query, int document_id) const {
+    return MatchQuery(*AcquireReadView().version, query.data_->query, document_id);
+}
+
+SearchServer::TupleType SearchServer::MatchDocument(const std::execution::sequenced_policy& policy, const PreparedQuery& query, int document_id) const {
+    return MatchDocument(query, document_id);
+}
+
+SearchServer::TupleType SearchServer::MatchDocument(const std::execution::parallel_policy& policy, const PreparedQuery& query, int document_id) const {
+    return MatchQuery(policy, *AcquireReadView().version, query.data_->query, document_id);
+}
+
+SearchServer::TupleType SearchServer::MatchQuery(const IndexVersion& version, const Query& query, int document_id) {
+    const auto location = version.FindDocument(document_id);
+    if (!location) {
+        throw std::out_of_range("Document id does not exist"s);
+    }
+    const IndexSegment& segment = version.segments[location->segment].data;
+    const int ordinal = location->ordinal;
+    const DocumentStatus status = segment.GetDocument(ordinal).status;
+    for (size_t i = 0; i < query.minus_terms.size(); ++i) {
+        if (segment.Contains(version.ResolveTerm(query.minus_terms[i], query.minus_words[i], query.term_count), ordinal)) {
+            return {std::vector<std::string_view>{}, status};
+        }
+    }
+    
     std::vector<std::string_view> matched_words;
+    matched_words.reserve(query.plus_terms.size());
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        if (segment.Contains(version.ResolveTerm(query.plus_terms[i], query.plus_words[i], query.term_count), ordinal)) {
+            matched_words.push_back(query.plus_words[i]);
+        }
+    }
+
+    return {std::move(matched_words), status};
+}
+
+SearchServer::TupleType SearchServer::MatchQuery(const std::execution::parallel_policy& policy, const IndexVersion& version, const Query& query,
+                                                 int document_id) {
+    const auto location = version.FindDocument(document_id);
+    if (!location) {
+        throw std::out_of_range("Document id does not exist"s);
+    }
+    const IndexSegment& segment = version.segments[location->segment].data;
+    const int ordinal = location->ordinal;
+    const DocumentStatus status = segment.GetDocument(ordinal).status;
+    const auto contains_word = [&version, &query, &segment, ordinal](const std::vector<TermId>& terms, const std::vector<std::string_view>& words,
+                                                                     const size_t position) {
+        return segment.Contains(version.ResolveTerm(terms[position], words[position], query.term_count), ordinal);
+    };
     
-    const auto find_word = std::find_if(query.minus_words.begin(), query.minus_words.end(), [this, &document_id]
-                                        (const auto word){
-                                            if(word_to_document_freqs_.count(word) == 0) {return false;}
-                                            return word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id) != 0;});
-    if(find_word != query.minus_words.end()) {
-        return {{}, documents_.at(document_id).status};
+    std::vector<size_t> positions(std::max(query.minus_words.size(), query.plus_words.size()));
+    std::iota(positions.begin(), positions.end(), 0);
+    if(std::any_of(std::execution::par, positions.begin(), positions.begin() + query.minus_words.size(), [&query, &contains_word](const size_t position) {
+           return contains_word(query.minus_terms, query.minus_words, position);
+       })) {
+        return {std::vector<std::string_view>{}, status};
     }
     
-    matched_words.resize(query.plus_words.size());
-    std::copy_if(std::execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [this, &document_id]
-                  (const auto word) {
-                      return word_to_document_freqs_.at(static_cast<std::string>(word)).count(document_id) != 0;});
+    std::vector<size_t> matched_positions(query.plus_words.size());
+    const auto last = std::copy_if(std::execution::par, positions.begin(), positions.begin() + query.plus_words.size(), matched_positions.begin(),
+                                   [&query, &contains_word](const size_t position) {
+                                       return contains_word(query.plus_terms, query.plus_words, position);
+                                   });
+    std::vector<std::string_view> matched_words(last - matched_positions.begin());
+    std::transform(matched_positions.begin(), last, matched_words.begin(),
+                   [&query](const size_t position) { return query.plus_words[position]; });
 
     std::sort(matched_words.begin(), matched_words.end());
     matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
-    matched_words.erase(std::find(matched_words.begin(), matched_words.end(), ""));
     
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, status};
 }
 
 bool SearchServer::IsStopWord(const std::string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(const std::string_view word) {
@@ -157,16 +647,21 @@ bool SearchServer::IsValidWord(const std::string_view word) {
     });
 }
 
-std::vector<std::string> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-    std::vector<std::string> words;
-    for (const auto word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument("Word contains an invalid character"s);
-		}
-        if (!IsStopWord(word)) {
-            words.push_back(static_cast<std::string>(word));
-        }
+void SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+    const size_t first = words.size();
+    if (!SplitIntoWords(text, words)) {
+        words.resize(first);
+        throw std::invalid_argument("Word contains an invalid character"s);
+    }
+    if (!stop_words_.IsEmpty()) {
+        words.erase(std::remove_if(words.begin() + first, words.end(), [this](const std::string_view word) {
+            return IsStopWord(word);
+        }), words.end());
     }
+}
+
+std::vector<std::string_view>& SearchServer::GetThreadWords() {
+    static thread_local std::vector<std::string_view> words;
     return words;
 }
 
@@ -178,7 +673,7 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text, bool is_valid_text) const {
     bool is_minus = false;
     if (text[0] == '-') {
         is_minus = true;
@@ -187,18 +682,22 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
     if (text.empty() || text[0] == '-') {
         throw std::invalid_argument("Wrong minus-word"s);
     }
-    if (!IsValidWord(text)) {
+    if (!is_valid_text && !IsValidWord(text)) {
         throw std::invalid_argument("Word contains an invalid character"s);
     }
 
     return {text, is_minus, IsStopWord(text)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::string_view text, const bool sorting) const {
+SearchServer::Query SearchServer::ParseQuery(const IndexVersion& version, std::string_view text, const bool sorting) const {
+    const QueryPhaseTimer timer(QueryPhase::PARSE);
    Query query;
-    const std::vector<std::string_view> words = SplitIntoWords(text);
-    std::for_each(words.begin(), words.end(), [&query, this](const std::string_view word) {
-        const QueryWord query_word = ParseQueryWord(word);
+    std::vector<std::string_view>& words = GetThreadWords();
+    words.clear();
+    const bool is_valid_text = SplitIntoWords(text, words);
+    query.plus_words.reserve(words.size());
+    std::for_each(words.begin(), words.end(), [&query, is_valid_text, this](const std::string_view word) {
+        const QueryWord query_word = ParseQueryWord(word, is_valid_text);
         if(!query_word.is_stop) {
             (query_word.is_minus ? query.minus_words.push_back(query_word.data) : query.plus_words.push_back(query_word.data));
         }
@@ -211,9 +710,263 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view text, const bool s
         std::sort(query.plus_words.begin(), query.plus_words.end());
         query.plus_words.erase(std::unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
     }
+
+    query.minus_terms.reserve(query.minus_words.size());
+    for (const auto word : query.minus_words) {
+        query.minus_terms.push_back(version.dictionary.FindTermId(word));
+    }
+    query.plus_terms.reserve(query.plus_words.size());
+    for (const auto word : query.plus_words) {
+        query.plus_terms.push_back(version.dictionary.FindTermId(word));
+    }
+    query.term_count = version.dictionary.GetTermCount();
     return query; 
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(static_cast<std::string>(word)).size());
+SearchServer::PreparedQuery SearchServer::PrepareQuery(const IndexVersion& version, std::string_view text) const {
+    auto data = std::make_shared<PreparedQuery::Data>();
+    data->text = text;
+    data->query = ParseQuery(version, data->text);
+    return PreparedQuery(std::move(data));
+}
+
+std::optional<SearchServer::PreparedQuery> SearchServer::PrepareCachedQuery(const IndexVersion& version, std::string_view text) const {
+    if (query_cache_.GetCapacity() == 0) {
+        return std::nullopt;
+    }
+    if (std::optional<PreparedQuery> query = query_cache_.Find(text)) {
+        return query;
+    }
+    PreparedQuery query = PrepareQuery(version, text);
+    query_cache_.Insert(text, query);
+    return query;
+}
+
+SearchServer::ReadView SearchServer::AcquireReadView() const {
+    std::shared_lock lock(mutex_);
+    std::shared_ptr<const IndexVersion> version = published_;
+    const EvaluationMode evaluation_mode = evaluation_mode_;
+    if (update_mode_ == UpdateMode::SNAPSHOT) {
+        lock.unlock();
+    }
+    return {std::move(lock), std::move(version), evaluation_mode};
+}
+
+std::unique_lock<std::shared_mutex> SearchServer::LockReadersForUpdate() {
+    if (update_mode_ == UpdateMode::SNAPSHOT) {
+        return std::unique_lock(mutex_, std::defer_lock);
+    }
+    return std::unique_lock(mutex_);
+}
+
+SearchServer::IndexVersion::Segment::Segment(IndexSegment segment)
+    : data(std::move(segment))
+    , tombstones(std::make_shared<std::vector<bool>>(data.GetDocumentCount(), false)) {
+}
+
+std::vector<bool>& SearchServer::IndexVersion::Segment::GetMutableTombstones() {
+    // Versions are copied under the writer lock the caller holds, so a count of one cannot grow meanwhile
+    if (tombstones.use_count() > 1) {
+        tombstones = std::make_shared<std::vector<bool>>(*tombstones);
+    }
+    return *tombstones;
+}
+
+std::optional<SearchServer::IndexVersion::DocumentLocation> SearchServer::IndexVersion::FindDocument(int document_id) const {
+    // A removed id can only be added again after its previous document, so the newest match decides
+    for (size_t segment = segments.size(); segment-- > 0;) {
+        const int ordinal = segments[segment].data.FindOrdinal(document_id);
+        if (ordinal >= 0) {
+            if (segments[segment].IsRemoved(ordinal)) {
+                return std::nullopt;
+            }
+            return DocumentLocation{segment, ordinal};
+        }
+    }
+    return std::nullopt;
+}
+
+TermId SearchServer::IndexVersion::ResolveTerm(TermId term_id, std::string_view word, TermId term_count) const {
+    // Terms are only ever appended, so an id names the same word in every version that has it
+    const TermId current_term_count = dictionary.GetTermCount();
+    if (term_count == current_term_count || (term_id != TermDictionary::NO_TERM && term_id < current_term_count)) {
+        return term_id;
+    }
+    return dictionary.FindTermId(word);
+}
+
+std::vector<TermId> SearchServer::IndexVersion::FindMinusTerms(const Query& query) const {
+    std::vector<TermId> terms;
+    terms.reserve(query.minus_terms.size());
+    for (size_t i = 0; i < query.minus_terms.size(); ++i) {
+        const TermId term_id = ResolveTerm(query.minus_terms[i], query.minus_words[i], query.term_count);
+        if (dictionary.GetDocumentFreq(term_id) > 0) {
+            terms.push_back(term_id);
+        }
+    }
+    return terms;
+}
+
+std::vector<std::pair<TermId, double>> SearchServer::IndexVersion::FindPlusTerms(const Query& query) const {
+    std::vector<std::pair<TermId, double>> terms;
+    terms.reserve(query.plus_terms.size());
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        const TermId term_id = ResolveTerm(query.plus_terms[i], query.plus_words[i], query.term_count);
+        if (dictionary.GetDocumentFreq(term_id) > 0) {
+            terms.push_back({term_id, std::log(static_cast<double>(document_count) / dictionary.GetDocumentFreq(term_id))});
+        }
+    }
+    return terms;
+}
+
+void SearchServer::IndexVersion::AddToBuffer(const DocumentData& document, const std::vector<std::pair<TermId, int>>& term_counts) {
+    Segment& buffer = segments.back();
+    buffer.data.AddDocument(document, term_counts);
+    buffer.GetMutableTombstones().push_back(false);
+    ++document_count;
+    ++generation;
+    if (buffer.data.GetDocumentCount() >= segment_size_) {
+        SealBuffer();
+        ApplyMergePolicy();
+    }
+}
+
+void SearchServer::IndexVersion::AddSegment(IndexSegment segment) {
+    SealBuffer();
+    document_count += segment.GetDocumentCount();
+    ++generation;
+    segments.insert(segments.end() - 1, Segment(std::move(segment)));
+    ApplyMergePolicy();
+}
+
+void SearchServer::IndexVersion::MarkRemoved(const DocumentLocation& location) {
+    Segment& segment = segments[location.segment];
+    segment.GetMutableTombstones()[location.ordinal] = true;
+    ++segment.removed_count;
+    --document_count;
+    ++generation;
+}
+
+void SearchServer::IndexVersion::CompactRemoved() {
+    bool is_compacted = false;
+    // The buffer drops its removed documents when it is sealed. From the newest, so a segment left empty and erased
+    // does not move the ones still to check
+    for (size_t segment = segments.size() - 1; segment-- > 0;) {
+        if (segments[segment].removed_count * compaction_ratio_ >= static_cast<size_t>(segments[segment].data.GetDocumentCount())) {
+            MergeSegments(segment, segment + 1);
+            is_compacted = true;
+        }
+    }
+    if (is_compacted) {
+        ++generation;
+    }
+}
+
+void SearchServer::IndexVersion::Compact() {
+    SealBuffer();
+    MergeSegments(0, segments.size() - 1);
+    ++generation;
+}
+
+void SearchServer::IndexVersion::FreezeBuffer() {
+    if (segments.back().data.GetDocumentCount() == 0) {
+        return;
+    }
+    segments.back().data.Freeze();
+    segments.emplace_back();
+    ApplyMergePolicy();
+}
+
+void SearchServer::IndexVersion::SealBuffer() {
+    if (segments.back().data.GetDocumentCount() == 0) {
+        return;
+    }
+    segments.emplace_back();
+    MergeSegments(segments.size() - 2, segments.size() - 1);
+}
+
+void SearchServer::IndexVersion::MergeSegments(size_t first, size_t last) {
+    if (first == last || (last - first == 1 && segments[first].removed_count == 0 && segments[first].data.IsSealed())) {
+        return;
+    }
+    std::vector<const IndexSegment*> sources;
+    std::vector<const std::vector<bool>*> tombstones;
+    bool all_frozen = true;
+    size_t live_count = 0;
+    for (size_t i = first; i < last; ++i) {
+        sources.push_back(&segments[i].data);
+        tombstones.push_back(segments[i].tombstones.get());
+        all_frozen = all_frozen && segments[i].data.IsFrozen();
+        live_count += segments[i].data.GetDocumentCount() - segments[i].removed_count;
+    }
+    // Frozen buffers are only sealed once they add up to a full one
+    IndexSegment merged = all_frozen && live_count < static_cast<size_t>(segment_size_) ? IndexSegment::MergeFrozen(sources, tombstones)
+                                                                                     : IndexSegment::Merge(sources, tombstones, dictionary.GetTermCount());
+    segments.erase(segments.begin() + first + 1, segments.begin() + last);
+    if (merged.GetDocumentCount() == 0) {
+        segments.erase(segments.begin() + first);
+    } else {
+        segments[first] = Segment(std::move(merged));
+    }
+}
+
+// The newest merge_factor_ sealed segments are merged once none of them is in a higher tier than the newest one;
+// a segment is in tier k when it holds at least merge_factor_^k live documents, so the small buffers frozen
+// by publishing snapshots merge among themselves before they reach the size of a full one
+void SearchServer::IndexVersion::ApplyMergePolicy() {
+    const auto get_tier = [](const Segment& segment) {
+        const size_t live_count = segment.data.GetDocumentCount() - segment.removed_count;
+        size_t tier = 0;
+        for (size_t size = merge_factor_; live_count >= size; size *= merge_factor_) {
+            ++tier;
+        }
+        return tier;
+    };
+    while (segments.size() > merge_factor_) {
+        const size_t last = segments.size() - 1;
+        const size_t first = last - merge_factor_;
+        const size_t newest_tier = get_tier(segments[last - 1]);
+        const bool same_tier = std::all_of(segments.begin() + first, segments.begin() + last, [&get_tier, newest_tier](const Segment& segment) {
+            return get_tier(segment) <= newest_tier;
+        });
+        if (!same_tier) {
+            return;
+        }
+        MergeSegments(first, last);
+    }
+}
+
+RelevanceAccumulator& SearchServer::GetThreadAccumulator() {
+    static thread_local RelevanceAccumulator accumulator;
+    return accumulator;
+}
+bool SearchServer::IsProbedMinusTerm(const IndexSegment& segment, TermId term_id, const std::vector<std::pair<TermId, double>>& plus_terms) {
+    size_t plus_posting_count = 0;
+    for (const auto& [plus_term_id, _] : plus_terms) {
+        plus_posting_count += segment.GetPostingCount(plus_term_id);
+    }
+    return segment.GetPostingCount(term_id) > plus_posting_count * minus_probe_ratio_;
+}
+
+void SearchServer::ExcludeProbedTerms(const IndexSegment& segment, const std::vector<TermId>& term_ids, int first, RelevanceAccumulator& accumulator) {
+    if (term_ids.empty()) {
+        return;
+    }
+    std::vector<int> offsets;
+    accumulator.ForEachScored([&offsets](int offset, double relevance) {
+        offsets.push_back(offset);
+    });
+    std::sort(offsets.begin(), offsets.end());
+    for (const TermId term_id : term_ids) {
+        PostingsCursor postings = segment.GetPostings(term_id, first);
+        for (const int offset : offsets) {
+            postings.SkipTo(first + offset);
+            if (postings.IsEnd()) {
+                break;
+            }
+            if (postings.GetOrdinal() == first + offset) {
+                accumulator.Exclude(offset);
+            }
+        }
+    }
 }
\ No newline at end of file
@@ -2,18 +2,46 @@
 #include "document.h"
 #include "read_input_functions.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "index_segment.h"
+#include "term_dictionary.h"
+#include "stop_word_set.h"
+#include "lru_cache.h"
+#include "result_cache.h"
+#include "search_deadline.h"
+#include "query_profile.h"
+#include "relevance_accumulator.h"
+#include "top_documents.h"
 
+#include <limits>
 #include <map>
-#include <set>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <stdexcept>
 #include <string>
 #include <algorithm>
 #include <execution>
+#include <future>
 #include <string_view>
 #include <type_traits>
 
+enum class EvaluationMode {
+    EXHAUSTIVE,
+    MAX_SCORE,
+};
+
+enum class UpdateMode {
+    // Updates are visible at once; they wait for running queries and queries wait for them
+    IMMEDIATE,
+    // Updates go to a private copy and become visible on PublishSnapshot; queries never wait for them
+    SNAPSHOT,
+};
+
 class SearchServer {
 public:
     template <typename StringContainer>
@@ -23,32 +51,177 @@ public:
     explicit SearchServer(const std::string_view stop_words_text);
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    struct DocumentInput {
+        int id;
+        std::string_view text;
+        DocumentStatus status;
+        std::vector<int> ratings;
+    };
+
+    struct DocumentError {
+        size_t position;
+        int document_id;
+        std::string message;
+    };
+
+    std::vector<DocumentError> AddDocuments(const std::vector<DocumentInput>& documents);
     
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // A query parsed and looked up in the index once, to be run any number of times on the server that prepared it;
+    // words the index did not have yet are looked up again once it gets new words
+    class PreparedQuery {
+    public:
+        const std::string& GetText() const;
+
+    private:
+        friend class SearchServer;
+        struct Data;
+
+        std::shared_ptr<const Data> data_;
+
+        explicit PreparedQuery(std::shared_ptr<const Data> data);
+    };
+
+    // Throws like the search by text would
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+    // The number of postings of the query words, which bounds the work of a search
+    size_t EstimateQueryCost(const PreparedQuery& query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy, const PreparedQuery& query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, const PreparedQuery& query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                           size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    struct SearchResult {
+        std::vector<Document> documents;
+        // Set when the search stopped at its deadline; the documents are then the best among those scored in full so far
+        bool is_partial = false;
+        // Set by the traced searches
+        std::optional<QueryTrace> trace;
+    };
+
+    // Sequenced searches that check the deadline between blocks of postings. They bypass the result cache. There is no
+    // parallel search with a deadline: the tasks of one could not stop together
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    SearchResult FindTopDocuments(const SearchDeadline& deadline, std::string_view raw_query, DocumentPredicate document_predicate,
+                                  size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    SearchResult FindTopDocuments(const SearchDeadline& deadline, std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                  size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    // Run on a thread of their own; the server must outlive the future
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
-    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL) const;
-    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL) const;
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL) const;
+    std::future<SearchResult> FindTopDocumentsAsync(SearchDeadline deadline, std::string raw_query, DocumentPredicate document_predicate,
+                                                    size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::future<SearchResult> FindTopDocumentsAsync(SearchDeadline deadline, std::string raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                                    size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Sequenced searches that also report where their time went; without SEARCH_SERVER_PROFILING the trace holds only the total time
+    template <typename DocumentPredicate>
+    SearchResult TraceTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    SearchResult TraceTopDocuments(std::string_view raw_query, DocumentStatus document_status = DocumentStatus::ACTUAL,
+                                   size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    // Every search is recorded when built with SEARCH_SERVER_PROFILING
+    const QueryProfile& GetQueryProfile() const;
+    void ResetQueryProfile();
+
+    // Keeps up to capacity queries parsed from text for searches and matches by text; zero, the default, disables it
+    void SetQueryCacheCapacity(size_t capacity);
+    size_t GetQueryCacheCapacity() const;
+
+    // Keeps about capacity results of searches by document status; entries computed before an update are not used after
+    // it becomes visible. Zero, the default, disables the cache
+    void SetResultCacheCapacity(size_t capacity);
+    ResultCache::Stats GetResultCacheStats() const;
 
     int GetDocumentCount() const;
 
-    auto begin() const {
-        return document_ids_.begin();
-    }
+    void SetEvaluationMode(EvaluationMode mode);
+    EvaluationMode GetEvaluationMode() const;
 
-    auto end() const {
-        return document_ids_.end();
-    }
+    void SetUpdateMode(UpdateMode mode);
+    UpdateMode GetUpdateMode() const;
+    // Freezes the documents added since the last publish into a segment of their own; the published version shares
+    // the segments and the dictionary with the draft, which copies only the pieces it changes next
+    void PublishSnapshot();
+
+    struct IndexVersion;
+
+    // Iterates over the index version current at begin(); in snapshot mode it is not affected by later updates
+    class DocumentIdIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        explicit DocumentIdIterator(std::shared_ptr<const IndexVersion> version);
+
+        reference operator*() const;
+        DocumentIdIterator& operator++();
+        DocumentIdIterator operator++(int);
+
+        bool operator==(const DocumentIdIterator& other) const;
+        bool operator!=(const DocumentIdIterator& other) const;
+
+    private:
+        std::shared_ptr<const IndexVersion> version_;
+        size_t segment_ = 0;
+        int ordinal_ = 0;
+
+        bool IsEnd() const;
+        void SkipRemoved();
+    };
+
+    DocumentIdIterator begin() const;
+    DocumentIdIterator end() const;
     
+    // The returned reference is invalidated when the removal of the document becomes visible: at once in immediate mode,
+    // in snapshot mode once the version published before the removal has no readers left
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
     
+    // Removed documents are only marked; their postings are dropped when their segment is rewritten by a merge or a
+    // compaction, never by the removal itself
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy& policy, int document_id);
     void RemoveDocument(const std::execution::parallel_policy& policy, int document_id);
+
+    // Merges all segments into one without removed documents
+    void CompactIndex();
+    // Rewrites the sealed and frozen segments of which removed documents make up at least a quarter. In snapshot mode PublishSnapshot
+    // does it before it copies the updates
+    void CompactRemovedDocuments();
+
+    // Writes the stop words and the live documents of the version queries see; the file is replaced only once complete
+    void SaveIndex(const std::string& path) const;
+    // Validates the file and serves queries from its mapped pages; nothing is re-indexed
+    static SearchServer LoadIndex(const std::string& path);
     
     using TupleType = std::tuple<std::vector<std::string_view>, DocumentStatus>;
 
@@ -57,168 +230,640 @@ public:
                                                                        std::string_view raw_query, int document_id) const;
     TupleType MatchDocument(const std::execution::parallel_policy& policy, 
                                                                        const std::string_view raw_query, int document_id) const;
+    TupleType MatchDocument(const PreparedQuery& query, int document_id) const;
+    TupleType MatchDocument(const std::execution::sequenced_policy& policy, const PreparedQuery& query, int document_id) const;
+    TupleType MatchDocument(const std::execution::parallel_policy& policy, const PreparedQuery& query, int document_id) const;
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    explicit SearchServer(IndexFileReader& reader);
+
+    StopWordSet stop_words_;
+    mutable LruCache<PreparedQuery> query_cache_;
+    mutable ResultCache result_cache_;
+    mutable QueryProfile query_profile_;
+
+    using WordFrequencies = std::map<std::string_view, double>;
+
+    // Word frequencies of documents of the published version, built on request and kept by document id, so segments can
+    // be sealed and merged under them
+    struct WordFrequencyCache {
+        std::mutex mutex;
+        std::unordered_map<int, std::shared_ptr<const WordFrequencies>> word_freqs;
     };
 
-    std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::vector<int> document_ids_;
+    mutable WordFrequencyCache word_freq_cache_;
+    // In snapshot mode, the documents removed from the draft since the last publication; their word frequencies stay
+    // in the cache while the published version serves them
+    std::vector<int> unpublished_removals_;
+    // Writers change draft_; in immediate mode published_ is the same object
+    std::shared_ptr<IndexVersion> draft_;
+    std::shared_ptr<const IndexVersion> published_;
+    EvaluationMode evaluation_mode_ = EvaluationMode::EXHAUSTIVE;
+    UpdateMode update_mode_ = UpdateMode::IMMEDIATE;
+    // Guards published_ and the modes; held by readers for the whole query only in immediate mode
+    mutable std::shared_mutex mutex_;
+    std::mutex writer_mutex_;
+
+    const static int min_part_size_ = 4096;
+    const static int min_batch_part_size_ = 256;
+    const static int parts_per_thread_ = 4;
+    const static size_t compaction_ratio_ = 4;
+    const static int segment_size_ = 4096;
+    const static size_t merge_factor_ = 4;
+    const static size_t minus_probe_ratio_ = 16;
 
     bool IsStopWord(const std::string_view word) const;
 
     static bool IsValidWord(const std::string_view word);
 
-    std::vector<std::string> SplitIntoWordsNoStop(std::string_view text) const;
+    // Appends the words of text that are not stop words; throws if a word contains a control character
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
+    // Reused by tokenization on the calling thread
+    static std::vector<std::string_view>& GetThreadWords();
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    // In snapshot mode only once the removal is published
+    void DropWordFrequencies(int document_id);
+    // Hands the word frequencies of the unpublished removals to the version about to be replaced; called with the
+    // mutex of the cache held
+    void RetireWordFrequencies(const IndexVersion& replaced_version);
+
+    struct ReadView {
+        std::shared_lock<std::shared_mutex> lock;
+        std::shared_ptr<const IndexVersion> version;
+        EvaluationMode evaluation_mode;
+    };
+
+    ReadView AcquireReadView() const;
+    std::unique_lock<std::shared_mutex> LockReadersForUpdate();
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // Words of a text that passed validation as a whole skip the check for control characters
+    QueryWord ParseQueryWord(std::string_view text, bool is_valid_text) const;
 
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
+        // Of the dictionary the terms were looked up in
+        TermId term_count = 0;
     };
 
-    Query ParseQuery(std::string_view text, const bool sorting = true) const;
+    Query ParseQuery(const IndexVersion& version, std::string_view text, const bool sorting = true) const;
+    PreparedQuery PrepareQuery(const IndexVersion& version, std::string_view text) const;
+    // Empty when the query cache is disabled
+    std::optional<PreparedQuery> PrepareCachedQuery(const IndexVersion& version, std::string_view text) const;
+
+    static TupleType MatchQuery(const IndexVersion& version, const Query& query, int document_id);
+    static TupleType MatchQuery(const std::execution::parallel_policy& policy, const IndexVersion& version, const Query& query, int document_id);
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    static RelevanceAccumulator& GetThreadAccumulator();
+    // A minus term whose postings in the segment outnumber those of all plus terms by minus_probe_ratio_ is not scanned;
+    // the scored documents are looked up in it instead
+    static bool IsProbedMinusTerm(const IndexSegment& segment, TermId term_id, const std::vector<std::pair<TermId, double>>& plus_terms);
+    // Excludes the scored documents of [first, first + accumulated count) that contain any of the terms
+    static void ExcludeProbedTerms(const IndexSegment& segment, const std::vector<TermId>& term_ids, int first, RelevanceAccumulator& accumulator);
 
+    // Sequenced searches follow the evaluation mode of the view
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    static std::vector<Document> FindTopDocuments(const ReadView& view, const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate,
+                                                  size_t top_count);
+    // Searches by document status go through the result cache when it is enabled
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindCachedTopDocuments(const ReadView& view, const ExecutionPolicy& policy, const Query& query, DocumentStatus document_status,
+                                                 size_t top_count) const;
+    static std::string MakeResultKey(const Query& query, char evaluation, DocumentStatus document_status, size_t top_count);
+    // Follows the evaluation mode of the view
+    template <typename DocumentPredicate>
+    static SearchResult FindTopDocumentsUntil(const ReadView& view, const SearchDeadline& deadline, const Query& query, DocumentPredicate document_predicate,
+                                              size_t top_count);
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query, DocumentPredicate document_predicate) const;
+    static SearchResult FindAllDocuments(const std::execution::sequenced_policy& policy, const IndexVersion& version, const Query& query,
+                                         DocumentPredicate document_predicate, size_t top_count, const SearchDeadline& deadline);
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query, DocumentPredicate document_predicate) const;
+    static std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const IndexVersion& version, const Query& query,
+                                                  DocumentPredicate document_predicate, size_t top_count);
+    template <typename DocumentPredicate>
+    static SearchResult FindAllDocumentsMaxScore(const IndexVersion& version, const Query& query, DocumentPredicate document_predicate, size_t top_count,
+                                                 const SearchDeadline& deadline);
+};
+
+struct SearchServer::IndexVersion {
+    struct Segment {
+        IndexSegment data;
+        // Shared with the copies of the version until one of them changes its own
+        std::shared_ptr<std::vector<bool>> tombstones;
+        size_t removed_count = 0;
+
+        explicit Segment(IndexSegment segment = IndexSegment());
+
+        bool IsRemoved(int ordinal) const {
+            return removed_count > 0 && (*tombstones)[ordinal];
+        }
+
+        std::vector<bool>& GetMutableTombstones();
+    };
+
+    struct DocumentLocation {
+        size_t segment;
+        int ordinal;
+    };
+
+    TermDictionary dictionary;
+    // Sealed and frozen segments from the oldest, then the mutable buffer that takes new documents
+    std::vector<Segment> segments = std::vector<Segment>(1);
+    size_t document_count = 0;
+    // Changes with every update, so results cached for one generation are never served for another
+    uint64_t generation = 0;
+    // Word frequencies of documents this version serves and the published one no longer does, freed with the version.
+    // Guarded by the mutex of the word frequency cache
+    mutable std::vector<std::shared_ptr<const WordFrequencies>> retired_word_freqs;
+
+    std::optional<DocumentLocation> FindDocument(int document_id) const;
+
+    // Ids from another version of the dictionary are kept where this one has them; missing words are looked up again
+    TermId ResolveTerm(TermId term_id, std::string_view word, TermId term_count) const;
+    std::vector<TermId> FindMinusTerms(const Query& query) const;
+    std::vector<std::pair<TermId, double>> FindPlusTerms(const Query& query) const;
+
+    void AddToBuffer(const DocumentData& document, const std::vector<std::pair<TermId, int>>& term_counts);
+    void AddSegment(IndexSegment segment);
+    // Term frequencies of the document are left to the caller
+    void MarkRemoved(const DocumentLocation& location);
+    void CompactRemoved();
+    void Compact();
+    // Freezes the buffer and starts another, so a copy shares every segment with this version
+    void FreezeBuffer();
+
+private:
+    void SealBuffer();
+    void MergeSegments(size_t first, size_t last);
+    void ApplyMergePolicy();
+};
+
+struct SearchServer::PreparedQuery::Data {
+    std::string text;
+    // Views text
+    Query query;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words) : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+SearchServer::SearchServer(const StringContainer& stop_words)
+    : draft_(std::make_shared<IndexVersion>())
+    , published_(draft_) {
     if(!all_of(stop_words.begin(), stop_words.end(), IsValidWord)) {
         using namespace std::string_literals;
         throw std::invalid_argument("Word contains an invalid character"s);
     }
+    stop_words_ = StopWordSet(std::vector<std::string_view>(stop_words.begin(), stop_words.end()));
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-    std::sort(std::execution::seq, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < relevance_flag) {
-            return lhs.rating > rhs.rating;
-        } else {
-            return lhs.relevance > rhs.relevance;
-        }
-    });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return FindTopDocuments(view, policy, query->data_->query, document_predicate, top_count);
     }
-    return matched_documents;
+    return FindTopDocuments(view, policy, ParseQuery(*view.version, raw_query), document_predicate, top_count);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-    std::sort(std::execution::par, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < relevance_flag) {
-            return lhs.rating > rhs.rating;
-        } else {
-            return lhs.relevance > rhs.relevance;
-        }
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return FindTopDocuments(view, policy, query->data_->query, document_predicate, top_count);
+    }
+    return FindTopDocuments(view, policy, ParseQuery(*view.version, raw_query), document_predicate, top_count);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate, size_t top_count) const {
+    return FindTopDocuments(std::execution::seq, query, document_predicate, top_count);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+                                                     size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    return FindTopDocuments(AcquireReadView(), policy, query.data_->query, document_predicate, top_count);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, const PreparedQuery& query, DocumentPredicate document_predicate,
+                                                     size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    return FindTopDocuments(AcquireReadView(), policy, query.data_->query, document_predicate, top_count);
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ReadView& view, const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate,
+                                                     size_t top_count) {
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+        return FindTopDocumentsUntil(view, SearchDeadline(), query, document_predicate, top_count).documents;
+    } else {
+        return FindAllDocuments(policy, *view.version, query, document_predicate, top_count);
+    }
+}
+
+template <typename DocumentPredicate>
+SearchServer::SearchResult SearchServer::FindTopDocuments(const SearchDeadline& deadline, std::string_view raw_query, DocumentPredicate document_predicate,
+                                                          size_t top_count) const {
+    const QueryProfile::Scope profile_scope(query_profile_);
+    const ReadView view = AcquireReadView();
+    if (const std::optional<PreparedQuery> query = PrepareCachedQuery(*view.version, raw_query)) {
+        return FindTopDocumentsUntil(view, deadline, query->data_->query, document_predicate, top_count);
+    }
+    return FindTopDocumentsUntil(view, deadline, ParseQuery(*view.version, raw_query), document_predicate, top_count);
+}
+
+template <typename DocumentPredicate>
+std::future<SearchServer::SearchResult> SearchServer::FindTopDocumentsAsync(SearchDeadline deadline, std::string raw_query, DocumentPredicate document_predicate,
+                                                                            size_t top_count) const {
+    return std::async(std::launch::async, [this, deadline = std::move(deadline), raw_query = std::move(raw_query), document_predicate, top_count] {
+        return FindTopDocuments(deadline, raw_query, document_predicate, top_count);
     });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+}
+
+template <typename DocumentPredicate>
+SearchServer::SearchResult SearchServer::TraceTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+    SearchResult result;
+    result.trace.emplace();
+    {
+        const QueryProfile::Scope profile_scope(query_profile_, *result.trace);
+        result.documents = FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_count);
     }
-    return matched_documents;
+    return result;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query, DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    
-    for (const auto word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+SearchServer::SearchResult SearchServer::FindTopDocumentsUntil(const ReadView& view, const SearchDeadline& deadline, const Query& query,
+                                                               DocumentPredicate document_predicate, size_t top_count) {
+    if (view.evaluation_mode == EvaluationMode::MAX_SCORE) {
+        return FindAllDocumentsMaxScore(*view.version, query, document_predicate, top_count, deadline);
+    }
+    return FindAllDocuments(std::execution::seq, *view.version, query, document_predicate, top_count, deadline);
+}
+
+template <typename DocumentPredicate>
+SearchServer::SearchResult SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const IndexVersion& version, const Query& query,
+                                                          DocumentPredicate document_predicate, size_t top_count, const SearchDeadline& deadline) {
+    QueryPhaseTimer timer(QueryPhase::PARSE);
+    const std::vector<TermId> minus_terms = version.FindMinusTerms(query);
+    const std::vector<std::pair<TermId, double>> plus_terms = version.FindPlusTerms(query);
+    RelevanceAccumulator& accumulator = GetThreadAccumulator();
+    TopDocuments top_documents(top_count);
+    std::vector<TermId> probed_terms;
+    const auto is_expired = [&deadline] {
+        return deadline.IsExpired();
+    };
+    bool is_partial = false;
+    size_t scored_count = 0;
+
+    for (const IndexVersion::Segment& segment : version.segments) {
+        // Clearing the scores of the previous segment counts as ranking
+        timer.Switch(QueryPhase::RANKING);
+        accumulator.Reset(segment.data.GetDocumentCount());
+        timer.Switch(QueryPhase::MINUS_FILTER);
+
+        // A segment adds its documents only once all its exclusions and scores are complete, so an expired segment adds
+        // nothing rather than documents ranked by some of their postings
+        probed_terms.clear();
+        for (const TermId term_id : minus_terms) {
+            if (IsProbedMinusTerm(segment.data, term_id, plus_terms)) {
+                probed_terms.push_back(term_id);
+                continue;
+            }
+            is_partial = !segment.data.GetPostings(term_id).ForEachUntil([&accumulator](int ordinal, double term_freq) {
+                accumulator.Exclude(ordinal);
+            }, is_expired);
+            if (is_partial) {
+                break;
+            }
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(static_cast<std::string>(word))) {
-            auto document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        if (is_partial) {
+            break;
+        }
+
+        timer.Switch(QueryPhase::POSTINGS);
+        for (const auto& [term_id, inverse_document_freq] : plus_terms) {
+            is_partial = !segment.data.GetPostings(term_id).ForEachUntil([&, inverse_document_freq = inverse_document_freq](int ordinal, double term_freq) {
+                if (accumulator.IsExcluded(ordinal) || segment.IsRemoved(ordinal)) {
+                    return;
+                }
+                const DocumentData& document_data = segment.data.GetDocument(ordinal);
+                if (document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                    accumulator.Add(ordinal, term_freq * inverse_document_freq);
+                }
+            }, is_expired);
+            if (is_partial) {
+                break;
             }
         }
+        if (is_partial) {
+            break;
+        }
+        timer.Switch(QueryPhase::MINUS_FILTER);
+        ExcludeProbedTerms(segment.data, probed_terms, 0, accumulator);
+
+        timer.Switch(QueryPhase::RANKING);
+        accumulator.ForEachScored([&segment, &top_documents, &scored_count](int ordinal, double relevance) {
+            const DocumentData& document_data = segment.data.GetDocument(ordinal);
+            top_documents.Add({
+                document_data.id,
+                relevance,
+                document_data.rating
+            });
+            ++scored_count;
+        });
     }
+    CountQueryWork(QueryCounter::DOCUMENTS_SCORED, scored_count);
+    return {top_documents.Extract(), is_partial, std::nullopt};
+}
 
-    for (const auto word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(static_cast<std::string>(word))) {
-            document_to_relevance.erase(document_id);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const IndexVersion& version, const Query& query,
+                                                     DocumentPredicate document_predicate, size_t top_count) {
+    QueryPhaseTimer timer(QueryPhase::PARSE);
+    const std::vector<TermId> minus_terms = version.FindMinusTerms(query);
+    const std::vector<std::pair<TermId, double>> plus_terms = version.FindPlusTerms(query);
+    timer.Stop();
+
+    struct Range {
+        const IndexVersion::Segment* segment;
+        int first;
+        int last;
+    };
+
+    std::vector<Range> ranges;
+    const int max_part_count = static_cast<int>(std::thread::hardware_concurrency()) * parts_per_thread_;
+    for (const IndexVersion::Segment& segment : version.segments) {
+        const int document_count = segment.data.GetDocumentCount();
+        const int part_count = std::max(1, std::min(document_count / min_part_size_, max_part_count));
+        for (int part = 0; part < part_count; ++part) {
+            ranges.push_back({&segment,
+                              static_cast<int>(static_cast<int64_t>(document_count) * part / part_count),
+                              static_cast<int>(static_cast<int64_t>(document_count) * (part + 1) / part_count)});
         }
     }
+    std::vector<std::vector<Document>> range_top_documents(ranges.size());
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({
-            document_id,
-            relevance,
-            documents_.at(document_id).rating
+    std::vector<size_t> positions(ranges.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    ParallelQueryTrace parallel_trace;
+    std::for_each(std::execution::par, positions.begin(), positions.end(), [&](const size_t position) {
+        const ParallelQueryTrace::Task task_trace(parallel_trace);
+        QueryPhaseTimer timer(QueryPhase::RANKING);
+        const auto [segment, first, last] = ranges[position];
+        RelevanceAccumulator& accumulator = GetThreadAccumulator();
+        accumulator.Reset(last - first);
+        timer.Switch(QueryPhase::MINUS_FILTER);
+
+        std::vector<TermId> probed_terms;
+        for (const TermId term_id : minus_terms) {
+            if (IsProbedMinusTerm(segment->data, term_id, plus_terms)) {
+                probed_terms.push_back(term_id);
+                continue;
+            }
+            segment->data.GetPostings(term_id, first).ForEachBefore(last, [&accumulator, first = first](int ordinal, double term_freq) {
+                accumulator.Exclude(ordinal - first);
+            });
+        }
+
+        timer.Switch(QueryPhase::POSTINGS);
+        for (const auto& [term_id, inverse_document_freq] : plus_terms) {
+            PostingsCursor postings = segment->data.GetPostings(term_id, first);
+            postings.ForEachBefore(last, [&, segment = segment, first = first, inverse_document_freq = inverse_document_freq]
+                                         (int ordinal, double term_freq) {
+                if (accumulator.IsExcluded(ordinal - first) || segment->IsRemoved(ordinal)) {
+                    return;
+                }
+                const DocumentData& document_data = segment->data.GetDocument(ordinal);
+                if (document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                    accumulator.Add(ordinal - first, term_freq * inverse_document_freq);
+                }
+            });
+        }
+        timer.Switch(QueryPhase::MINUS_FILTER);
+        ExcludeProbedTerms(segment->data, probed_terms, first, accumulator);
+
+        timer.Switch(QueryPhase::RANKING);
+        TopDocuments top_documents(top_count);
+        size_t scored_count = 0;
+        accumulator.ForEachScored([segment = segment, first = first, &top_documents, &scored_count](int offset, double relevance) {
+            const DocumentData& document_data = segment->data.GetDocument(first + offset);
+            top_documents.Add({
+                document_data.id,
+                relevance,
+                document_data.rating
+            });
+            ++scored_count;
         });
+        range_top_documents[position] = top_documents.Extract();
+        CountQueryWork(QueryCounter::DOCUMENTS_SCORED, scored_count);
+    });
+
+    const QueryPhaseTimer merge_timer(QueryPhase::RANKING);
+    TopDocuments top_documents(top_count);
+    for (const std::vector<Document>& documents : range_top_documents) {
+        for (const Document& document : documents) {
+            top_documents.Add(document);
+        }
     }
-    return matched_documents;
+    return top_documents.Extract();
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(100);
-    
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [this, document_predicate, &document_to_relevance](const auto& word) {
-        if(word_to_document_freqs_.count(word) != 0) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(static_cast<std::string>(word))) {
-            auto document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+SearchServer::SearchResult SearchServer::FindAllDocumentsMaxScore(const IndexVersion& version, const Query& query, DocumentPredicate document_predicate,
+                                                                  size_t top_count, const SearchDeadline& deadline) {
+    QueryPhaseTimer timer(QueryPhase::PARSE);
+    const std::vector<TermId> minus_terms = version.FindMinusTerms(query);
+    const std::vector<std::pair<TermId, double>> plus_terms = version.FindPlusTerms(query);
+
+    // Of the plus term at position in the query
+    struct TermBound {
+        size_t position;
+        double inverse_document_freq;
+        double max_score;
+    };
+
+    struct TermCursor {
+        PostingsCursor postings;
+        size_t position;
+        double inverse_document_freq;
+        double max_score;
+    };
+
+    TopDocuments top_documents(top_count);
+    // Documents at or below the threshold can not beat the worst document in a full top, even on rating
+    double threshold = -std::numeric_limits<double>::infinity();
+    std::vector<TermBound> bounds;
+    std::vector<TermCursor> cursors;
+    std::vector<PostingsCursor> minus_cursors;
+    std::vector<double> max_score_prefix;
+    // The scores of the candidate by query position, summed in query order like the exhaustive search sums them,
+    // so both rank with the same relevances to the last bit
+    std::vector<double> term_scores(plus_terms.size(), 0.0);
+    bounds.reserve(plus_terms.size());
+    cursors.reserve(plus_terms.size());
+    minus_cursors.reserve(minus_terms.size());
+    max_score_prefix.reserve(plus_terms.size());
+    size_t candidate_count = 0;
+    size_t scored_count = 0;
+    bool is_partial = false;
+
+    // Segments are evaluated one after another and share the top, so the threshold reached in one prunes the next.
+    // Candidates are filtered and ranked as their postings are traversed, so all of it is timed as traversal
+    timer.Switch(QueryPhase::POSTINGS);
+    for (const IndexVersion::Segment& segment : version.segments) {
+        // Candidates come in increasing order, so minus postings are skipped to each of them rather than scanned
+        minus_cursors.clear();
+        for (const TermId term_id : minus_terms) {
+            minus_cursors.push_back(segment.data.GetPostings(term_id));
+        }
+        const auto is_excluded = [&minus_cursors](int candidate) {
+            for (PostingsCursor& postings : minus_cursors) {
+                postings.SkipTo(candidate);
+                if (!postings.IsEnd() && postings.GetOrdinal() == candidate) {
+                    return true;
                 }
             }
+            return false;
+        };
+
+        // Terms are ordered by their bounds before the cursors are opened, as cursors are too large to sort
+        bounds.clear();
+        for (size_t position = 0; position < plus_terms.size(); ++position) {
+            const auto& [term_id, inverse_document_freq] = plus_terms[position];
+            const double max_term_freq = segment.data.GetMaxTermFreq(term_id);
+            if (max_term_freq > 0.0) {
+                bounds.push_back({position, inverse_document_freq, max_term_freq * inverse_document_freq});
+            }
         }
-    });
-    
-    
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [this, &document_to_relevance](const auto& word){
-        if(word_to_document_freqs_.count(word) != 0){
-            for (const auto& [document_id, _] : word_to_document_freqs_.at(static_cast<std::string>(word))) {
-                document_to_relevance.Erase(document_id);
+        std::sort(bounds.begin(), bounds.end(), [](const TermBound& lhs, const TermBound& rhs) {
+            return lhs.max_score < rhs.max_score;
+        });
+        cursors.clear();
+        for (const TermBound& bound : bounds) {
+            cursors.push_back({segment.data.GetPostings(plus_terms[bound.position].first), bound.position, bound.inverse_document_freq, bound.max_score});
+        }
+
+        // max_score_prefix[i] bounds the relevance a document can get from cursors 0..i
+        max_score_prefix.clear();
+        double max_score_sum = 0.0;
+        for (const TermCursor& cursor : cursors) {
+            max_score_sum += cursor.max_score;
+            max_score_prefix.push_back(max_score_sum);
+        }
+
+        const int no_candidate = std::numeric_limits<int>::max();
+        const auto find_candidate = [&cursors, no_candidate](size_t first_essential) {
+            int candidate = no_candidate;
+            for (size_t i = first_essential; i < cursors.size(); ++i) {
+                const TermCursor& cursor = cursors[i];
+                if (!cursor.postings.IsEnd()) {
+                    candidate = std::min(candidate, cursor.postings.GetOrdinal());
+                }
             }
+            return candidate;
+        };
+
+        size_t first_essential = 0;
+        while (first_essential < cursors.size() && max_score_prefix[first_essential] <= threshold) {
+            ++first_essential;
         }
-    });
+        int next_candidate = find_candidate(first_essential);
 
-    std::vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({
-            document_id,
-            relevance,
-            documents_.at(document_id).rating
-        });
+        while (next_candidate != no_candidate) {
+            // The deadline is checked about as often as by the exhaustive search, once per block of candidates;
+            // every document added so far has its full relevance
+            if (++candidate_count % POSTING_BLOCK_SIZE == 0 && deadline.IsExpired()) {
+                is_partial = true;
+                break;
+            }
+            const int candidate = next_candidate;
+            next_candidate = no_candidate;
+            double relevance = 0.0;
+            for (const TermCursor& cursor : cursors) {
+                term_scores[cursor.position] = 0.0;
+            }
+            for (size_t i = first_essential; i < cursors.size(); ++i) {
+                TermCursor& cursor = cursors[i];
+                if (!cursor.postings.IsEnd() && cursor.postings.GetOrdinal() == candidate) {
+                    term_scores[cursor.position] = cursor.postings.GetTermFreq() * cursor.inverse_document_freq;
+                    relevance += term_scores[cursor.position];
+                    cursor.postings.Next();
+                }
+                if (!cursor.postings.IsEnd()) {
+                    next_candidate = std::min(next_candidate, cursor.postings.GetOrdinal());
+                }
+            }
+
+            if (segment.IsRemoved(candidate) || is_excluded(candidate)) {
+                continue;
+            }
+            const DocumentData& document_data = segment.data.GetDocument(candidate);
+            if (!document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                continue;
+            }
+
+            bool pruned = false;
+            for (size_t i = first_essential; i-- > 0;) {
+                if (relevance + max_score_prefix[i] <= threshold) {
+                    pruned = true;
+                    break;
+                }
+                TermCursor& cursor = cursors[i];
+                cursor.postings.SkipTo(candidate);
+                if (!cursor.postings.IsEnd() && cursor.postings.GetOrdinal() == candidate) {
+                    term_scores[cursor.position] = cursor.postings.GetTermFreq() * cursor.inverse_document_freq;
+                    relevance += term_scores[cursor.position];
+                }
+            }
+            if (pruned) {
+                continue;
+            }
+            relevance = 0.0;
+            for (const double term_score : term_scores) {
+                relevance += term_score;
+            }
+            if (relevance <= threshold) {
+                continue;
+            }
+
+            top_documents.Add({document_data.id, relevance, document_data.rating});
+            ++scored_count;
+            if (top_documents.IsFull()) {
+                threshold = top_documents.GetWorst().relevance - relevance_flag;
+                const size_t previous_first_essential = first_essential;
+                while (first_essential < cursors.size() && max_score_prefix[first_essential] <= threshold) {
+                    ++first_essential;
+                }
+                if (first_essential != previous_first_essential) {
+                    next_candidate = find_candidate(first_essential);
+                }
+            }
+        }
+        if (is_partial) {
+            break;
+        }
     }
-    return matched_documents;
+    timer.Switch(QueryPhase::RANKING);
+    CountQueryWork(QueryCounter::DOCUMENTS_SCORED, scored_count);
+    return {top_documents.Extract(), is_partial, std::nullopt};
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "stop_word_set.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+StopWordSet::StopWordSet(std::vector<std::string_view> words) {
+    words.erase(std::remove(words.begin(), words.end(), std::string_view()), words.end());
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    for (const std::string_view word : words) {
+        words_.push_back({static_cast<uint32_t>(text_.size()), static_cast<uint32_t>(word.size())});
+        text_ += word;
+        max_size_ = std::max(max_size_, word.size());
+        AddToFilter(word);
+    }
+    if (words_.empty()) {
+        return;
+    }
+    // Twice as many slots as words and about two words per bucket
+    int slot_bits = 1;
+    while ((size_t{1} << slot_bits) < words_.size() * 2) {
+        ++slot_bits;
+    }
+    const int bucket_bits = std::max(1, slot_bits - 2);
+    while (!PlaceWords(slot_bits, bucket_bits)) {
+        ++slot_bits;
+    }
+}
+
+bool StopWordSet::IsEmpty() const {
+    return words_.empty();
+}
+
+size_t StopWordSet::GetSize() const {
+    return words_.size();
+}
+
+std::vector<std::string_view> StopWordSet::GetWords() const {
+    std::vector<std::string_view> words;
+    words.reserve(words_.size());
+    for (const Word& word : words_) {
+        words.push_back(GetWord(word));
+    }
+    return words;
+}
+
+std::string_view StopWordSet::GetWord(const Word& word) const {
+    return std::string_view(text_).substr(word.offset, word.size);
+}
+
+void StopWordSet::AddToFilter(std::string_view word) {
+    for (const uint32_t index : {GetFilterIndex(word.size(), word.front(), FIRST_BYTE_MULTIPLIER),
+                                 GetFilterIndex(word.size(), word.back(), LAST_BYTE_MULTIPLIER)}) {
+        filter_[index / 64] |= uint64_t{1} << (index % 64);
+    }
+}
+
+bool StopWordSet::PlaceWords(int slot_bits, int bucket_bits) {
+    const int max_attempts = 1 << 12;
+    slot_shift_ = 64 - slot_bits;
+    bucket_shift_ = 64 - bucket_bits;
+    slots_.assign(size_t{1} << slot_bits, Word{});
+    bucket_seeds_.assign(size_t{1} << bucket_bits, 0);
+
+    std::vector<uint64_t> hashes(words_.size());
+    std::vector<std::vector<size_t>> buckets(bucket_seeds_.size());
+    for (size_t i = 0; i < words_.size(); ++i) {
+        hashes[i] = Hash(GetWord(words_[i]));
+        buckets[hashes[i] >> bucket_shift_].push_back(i);
+    }
+    std::vector<size_t> order(buckets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    std::vector<bool> is_used(slots_.size(), false);
+    std::vector<size_t> bucket_slots;
+    std::mt19937_64 generator(slot_bits);
+    for (const size_t bucket : order) {
+        bool is_placed = false;
+        for (int attempt = 0; attempt < max_attempts && !is_placed && !buckets[bucket].empty(); ++attempt) {
+            const uint64_t seed = generator();
+            bucket_slots.clear();
+            is_placed = std::all_of(buckets[bucket].begin(), buckets[bucket].end(), [&](size_t i) {
+                const size_t slot = GetSlot(hashes[i], seed);
+                if (is_used[slot] || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+                    return false;
+                }
+                bucket_slots.push_back(slot);
+                return true;
+            });
+            if (is_placed) {
+                bucket_seeds_[bucket] = seed;
+                for (size_t j = 0; j < bucket_slots.size(); ++j) {
+                    is_used[bucket_slots[j]] = true;
+                    slots_[bucket_slots[j]] = words_[buckets[bucket][j]];
+                }
+            }
+        }
+        if (!is_placed && !buckets[bucket].empty()) {
+            return false;
+        }
+    }
+    return true;
+}
\ No newline at end of file
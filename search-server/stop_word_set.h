@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A fixed set of words compiled into a perfect hash table: every word has a slot of its own, found through the seed of
+// its bucket, so a lookup compares against one candidate at most. A Bloom-style filter on the length and the first and
+// last bytes turns most other words away before hashing
+class StopWordSet {
+public:
+    StopWordSet() = default;
+    // Empty words are skipped and repeated ones kept once
+    explicit StopWordSet(std::vector<std::string_view> words);
+
+    bool Contains(std::string_view word) const {
+        if (word.empty() || word.size() > max_size_ || !HasFilterBit(GetFilterIndex(word.size(), word.front(), FIRST_BYTE_MULTIPLIER))
+            || !HasFilterBit(GetFilterIndex(word.size(), word.back(), LAST_BYTE_MULTIPLIER))) {
+            return false;
+        }
+        const Word& slot = slots_[GetSlot(Hash(word))];
+        return slot.size == word.size() && std::memcmp(text_.data() + slot.offset, word.data(), word.size()) == 0;
+    }
+
+    bool IsEmpty() const;
+    size_t GetSize() const;
+    // In lexicographic order
+    std::vector<std::string_view> GetWords() const;
+
+private:
+    struct Word {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    static const uint32_t FIRST_BYTE_MULTIPLIER = 0x9E3779B1;
+    static const uint32_t LAST_BYTE_MULTIPLIER = 0x85EBCA77;
+    static const uint64_t SLOT_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+    static const int FILTER_BITS = 12;
+
+    std::string text_;
+    std::vector<Word> words_;
+    // Both tables have a power of two size of at least two, so the shifts stay below 64
+    std::vector<Word> slots_;
+    std::vector<uint64_t> bucket_seeds_;
+    std::array<uint64_t, (1 << FILTER_BITS) / 64> filter_{};
+    size_t max_size_ = 0;
+    int bucket_shift_ = 63;
+    int slot_shift_ = 63;
+
+    static uint64_t Hash(std::string_view word) {
+        const auto mix = [](uint64_t hash) {
+            hash *= 0xFF51AFD7ED558CCDULL;
+            return hash ^ hash >> 32;
+        };
+        uint64_t hash = word.size() * 0x9E3779B97F4A7C15ULL;
+        size_t i = 0;
+        for (; i + 8 <= word.size(); i += 8) {
+            uint64_t chunk;
+            std::memcpy(&chunk, word.data() + i, 8);
+            hash = mix(hash ^ chunk);
+        }
+        uint64_t tail = 0;
+        for (int shift = 0; i < word.size(); ++i, shift += 8) {
+            tail |= static_cast<uint64_t>(static_cast<unsigned char>(word[i])) << shift;
+        }
+        return mix(hash ^ tail);
+    }
+
+    static uint32_t GetFilterIndex(size_t size, char byte, uint32_t multiplier) {
+        return (static_cast<uint32_t>(size << 8 | static_cast<unsigned char>(byte)) * multiplier) >> (32 - FILTER_BITS);
+    }
+
+    bool HasFilterBit(uint32_t index) const {
+        return (filter_[index / 64] >> (index % 64) & 1) != 0;
+    }
+
+    // The top bits of the hash pick the bucket; the hash mixed with the bucket seed picks the slot
+    size_t GetSlot(uint64_t hash) const {
+        return GetSlot(hash, bucket_seeds_[hash >> bucket_shift_]);
+    }
+
+    size_t GetSlot(uint64_t hash, uint64_t seed) const {
+        return ((hash ^ seed) * SLOT_MULTIPLIER) >> slot_shift_;
+    }
+
+    std::string_view GetWord(const Word& word) const;
+    void AddToFilter(std::string_view word);
+    // Seeds the buckets from the largest, retrying seeds until the words of a bucket land in distinct free slots
+    bool PlaceWords(int slot_bits, int bucket_bits);
+};
\ No newline at end of file
@@ -0,0 +1,26 @@
+#include "string_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+StringArena::StringArena(size_t block_size) : block_size_(block_size) {
+}
+
+std::string_view StringArena::Store(std::string_view text) {
+    if (text.size() > free_size_) {
+        const size_t size = std::max(block_size_, text.size());
+        blocks_.push_back(std::make_unique<char[]>(size));
+        free_begin_ = blocks_.back().get();
+        free_size_ = size;
+    }
+    char* data = free_begin_;
+    std::memcpy(data, text.data(), text.size());
+    free_begin_ += text.size();
+    free_size_ -= text.size();
+    used_size_ += text.size();
+    return {data, text.size()};
+}
+
+size_t StringArena::GetUsedSize() const {
+    return used_size_;
+}
\ No newline at end of file
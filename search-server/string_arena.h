@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class StringArena {
+public:
+    explicit StringArena(size_t block_size = 64 * 1024);
+
+    std::string_view Store(std::string_view text);
+
+    size_t GetUsedSize() const;
+
+private:
+    size_t block_size_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* free_begin_ = nullptr;
+    size_t free_size_ = 0;
+    size_t used_size_ = 0;
+};
\ No newline at end of file
@@ -2,17 +2,115 @@
 
 #include "string_processing.h"
 
+#include <cstdint>
 
-std::vector<std::string_view> SplitIntoWords(std::string_view text) {
-    std::vector<std::string_view> words;
-    text.remove_prefix(std::min(text.size(), text.find_first_not_of(" ")));
-    
-    while (!text.empty()) {
-        int64_t space = text.find(' ');
-        words.push_back(text.substr(0, space));
-        text.remove_prefix(std::min(text.size(), text.find(' ')));
-        text.remove_prefix(std::min(text.size(), text.find_first_not_of(" ")));
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+int CountTrailingZeros(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int count = 0;
+    for (; (mask & 1) == 0; mask >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Word boundaries come from a mask of the spaces in a block of bytes: a word starts at a non-space after a space and
+// ends at a space after a non-space, so the boundaries alternate between starts and ends
+class WordCollector {
+public:
+    WordCollector(std::string_view text, std::vector<std::string_view>& words)
+        : text_(text)
+        , words_(words) {
+    }
+
+    void AddBlock(size_t position, uint32_t spaces, int width) {
+        const uint32_t block_mask = width == 32 ? ~0u : (1u << width) - 1;
+        const uint32_t preceded_by_space = (spaces << 1 | (in_word_ ? 0 : 1)) & block_mask;
+        uint32_t boundaries = (~spaces & preceded_by_space) | (spaces & ~preceded_by_space & block_mask);
+        while (boundaries != 0) {
+            AddBoundary(position + CountTrailingZeros(boundaries));
+            boundaries &= boundaries - 1;
+        }
+    }
+
+    void AddByte(size_t position, bool is_space) {
+        if (is_space == in_word_) {
+            AddBoundary(position);
+        }
+    }
+
+    void Finish() {
+        if (in_word_) {
+            AddBoundary(text_.size());
+        }
+    }
+
+private:
+    std::string_view text_;
+    std::vector<std::string_view>& words_;
+    bool in_word_ = false;
+    size_t word_begin_ = 0;
+
+    void AddBoundary(size_t position) {
+        if (in_word_) {
+            words_.push_back(text_.substr(word_begin_, position - word_begin_));
+        } else {
+            word_begin_ = position;
+        }
+        in_word_ = !in_word_;
     }
+};
+
+}
 
+std::vector<std::string_view> SplitIntoWords(std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
     return words;
+}
+
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    WordCollector collector(text, words);
+    const char* data = text.data();
+    size_t position = 0;
+    bool has_control = false;
+    // Control characters are the bytes from 0 to 31; as signed bytes the ones from 128 are negative and stay valid
+#if defined(__AVX2__)
+    const __m256i space_bytes = _mm256_set1_epi8(' ');
+    const __m256i minus_one_bytes = _mm256_set1_epi8(-1);
+    __m256i controls = _mm256_setzero_si256();
+    for (; position + 32 <= text.size(); position += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+        controls = _mm256_or_si256(controls, _mm256_and_si256(_mm256_cmpgt_epi8(bytes, minus_one_bytes), _mm256_cmpgt_epi8(space_bytes, bytes)));
+        collector.AddBlock(position, static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, space_bytes))), 32);
+    }
+    has_control = !_mm256_testz_si256(controls, controls);
+#elif defined(__SSE2__)
+    const __m128i space_bytes = _mm_set1_epi8(' ');
+    const __m128i minus_one_bytes = _mm_set1_epi8(-1);
+    __m128i controls = _mm_setzero_si128();
+    for (; position + 16 <= text.size(); position += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+        controls = _mm_or_si128(controls, _mm_and_si128(_mm_cmpgt_epi8(bytes, minus_one_bytes), _mm_cmplt_epi8(bytes, space_bytes)));
+        collector.AddBlock(position, static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, space_bytes))), 16);
+    }
+    has_control = _mm_movemask_epi8(controls) != 0;
+#endif
+    for (; position < text.size(); ++position) {
+        const char c = data[position];
+        has_control |= c >= '\0' && c < ' ';
+        collector.AddByte(position, c == ' ');
+    }
+    collector.Finish();
+    return !has_control;
 }
\ No newline at end of file
@@ -2,17 +2,9 @@
 
 #include <vector>
 #include <string>
-#include <set>
+#include <string_view>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
-
-template <typename StringContainer>
-std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    std::set<std::string, std::less<>> non_empty_strings;
-    for (const auto& str : strings) {
-        if (!str.empty()) {
-            non_empty_strings.insert(static_cast<std::string>(str));
-        }
-    }
-    return non_empty_strings;
-}
\ No newline at end of file
+// Appends the space-separated words of text to words in one pass that also looks for control characters;
+// returns false if any word contains one
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "term_dictionary.h"
+
+#include <mutex>
+#include <string>
+
+TermId TermDictionary::AddTerm(std::string_view word) {
+    TermIds::Shard& shard = term_ids_->GetShard(word);
+    const auto iterator = shard.ids.find(word);
+    if (iterator != shard.ids.end()) {
+        return iterator->second;
+    }
+    const TermId term_id = static_cast<TermId>(terms_.size());
+    const std::string_view term = term_storage_->Store(word);
+    {
+        std::unique_lock lock(shard.mutex);
+        shard.ids.emplace(term, term_id);
+    }
+    terms_.push_back(term);
+    document_freqs_.push_back(0);
+    return term_id;
+}
+
+std::string_view TermDictionary::GetTerm(TermId term_id) const {
+    return terms_[term_id];
+}
+
+TermId TermDictionary::FindTermId(std::string_view word) const {
+    const TermIds::Shard& shard = term_ids_->GetShard(word);
+    std::shared_lock lock(shard.mutex);
+    const auto iterator = shard.ids.find(word);
+    // Terms the copy adding them has since added are not in this one
+    if (iterator == shard.ids.end() || iterator->second >= GetTermCount()) {
+        return NO_TERM;
+    }
+    return iterator->second;
+}
+
+TermId TermDictionary::GetTermCount() const {
+    return static_cast<TermId>(terms_.size());
+}
+
+void TermDictionary::IncrementDocumentFreq(TermId term_id) {
+    ++document_freqs_.GetMutable(term_id);
+}
+
+void TermDictionary::DecrementDocumentFreq(TermId term_id) {
+    --document_freqs_.GetMutable(term_id);
+}
+
+size_t TermDictionary::GetDocumentFreq(TermId term_id) const {
+    return term_id == NO_TERM ? 0 : document_freqs_[term_id];
+}
+
+void TermDictionary::Save(IndexFileWriter& writer) const {
+    std::vector<uint64_t> term_offsets(1, 0);
+    std::string text;
+    std::vector<size_t> document_freqs;
+    term_offsets.reserve(terms_.size() + 1);
+    document_freqs.reserve(terms_.size());
+    for (size_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        text += terms_[term_id];
+        term_offsets.push_back(text.size());
+        document_freqs.push_back(document_freqs_[term_id]);
+    }
+    writer.WriteArray(term_offsets);
+    writer.WriteString(text);
+    writer.WriteArray(document_freqs);
+}
+
+TermDictionary TermDictionary::Load(IndexFileReader& reader) {
+    using namespace std::string_literals;
+    TermDictionary dictionary;
+    dictionary.file_ = reader.GetFile();
+    const MappedArray<uint64_t> term_offsets = reader.ReadArray<uint64_t>();
+    const std::string_view text = reader.ReadString();
+    const MappedArray<size_t> document_freqs = reader.ReadArray<size_t>();
+    const size_t term_count = document_freqs.size();
+    if (term_offsets.size() != term_count + 1 || term_offsets.back() > text.size()) {
+        throw std::runtime_error("Index file has an inconsistent dictionary"s);
+    }
+    dictionary.terms_.reserve(term_count);
+    dictionary.document_freqs_.reserve(term_count);
+    for (TermIds::Shard& shard : dictionary.term_ids_->shards) {
+        shard.ids.reserve(term_count / dictionary.term_ids_->shards.size());
+    }
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        const std::string_view term = text.substr(term_offsets[term_id], term_offsets[term_id + 1] - term_offsets[term_id]);
+        dictionary.terms_.push_back(term);
+        dictionary.term_ids_->GetShard(term).ids.emplace(term, static_cast<TermId>(term_id));
+        dictionary.document_freqs_.push_back(document_freqs[term_id]);
+    }
+    return dictionary;
+}
\ No newline at end of file
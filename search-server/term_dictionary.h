@@ -0,0 +1,60 @@
+#pragma once
+#include "copy_on_write_array.h"
+#include "index_file.h"
+#include "string_arena.h"
+
+#include <array>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = int;
+
+// Maps words to dense ids and keeps the number of live documents containing each word. Copies share their data
+// until they change it, so of a dictionary and its copies only one may add terms; the others find those up to
+// their own term count
+class TermDictionary {
+public:
+    TermId AddTerm(std::string_view word);
+
+    std::string_view GetTerm(TermId term_id) const;
+    TermId FindTermId(std::string_view word) const;
+    TermId GetTermCount() const;
+
+    void IncrementDocumentFreq(TermId term_id);
+    void DecrementDocumentFreq(TermId term_id);
+    // Zero for NO_TERM
+    size_t GetDocumentFreq(TermId term_id) const;
+
+    void Save(IndexFileWriter& writer) const;
+    // Terms view the file; the id map and the document frequencies are rebuilt in memory
+    static TermDictionary Load(IndexFileReader& reader);
+
+    static const TermId NO_TERM = -1;
+
+private:
+    // The copy that adds terms looks them up without locking, as only it changes the map
+    struct TermIds {
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<std::string_view, TermId> ids;
+        };
+
+        std::array<Shard, 16> shards;
+
+        Shard& GetShard(std::string_view word) {
+            return shards[std::hash<std::string_view>()(word) % shards.size()];
+        }
+    };
+
+    // Copies of the dictionary share the append-only storage, so terms stored by one copy never move under another
+    std::shared_ptr<StringArena> term_storage_ = std::make_shared<StringArena>();
+    // Holds the terms of a loaded dictionary
+    std::shared_ptr<const MappedFile> file_;
+    std::shared_ptr<TermIds> term_ids_ = std::make_shared<TermIds>();
+    CopyOnWriteArray<std::string_view> terms_;
+    CopyOnWriteArray<size_t> document_freqs_;
+};
\ No newline at end of file
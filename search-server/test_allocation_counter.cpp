@@ -0,0 +1,66 @@
+// Kept apart from the tests, as code that inlines these functions next to the library ones gets false warnings of
+// mismatched allocation and deallocation
+#if defined(SEARCH_SERVER_TESTS) && !defined(SEARCH_SERVER_PROFILING)
+#include "test_allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Counts the allocations of the calling thread while CountAllocations runs. Every form but the aligned ones is
+// replaced, so none of them pairs with a function of the library
+void* operator new(std::size_t size) {
+    if (is_counting_allocations) {
+        ++allocation_count;
+    }
+    for (;;) {
+        if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+            return pointer;
+        }
+        const std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "query_profile.h"
+
+#include <cstdint>
+
+#ifndef SEARCH_SERVER_PROFILING
+// Read by the allocation functions test_allocation_counter.cpp replaces in the test build
+inline thread_local bool is_counting_allocations = false;
+inline thread_local uint64_t allocation_count = 0;
+#endif
+
+// The allocations the calling thread makes while the function runs; counted only in the test build
+template <typename Function>
+uint64_t CountAllocations(Function function) {
+#ifdef SEARCH_SERVER_PROFILING
+    // query_profile.cpp replaces the allocation functions and counts into the trace current on the thread
+    QueryTrace trace;
+    {
+        const QueryTraceScope scope(trace);
+        function();
+    }
+    return trace.GetCount(QueryCounter::ALLOCATIONS);
+#else
+    allocation_count = 0;
+    is_counting_allocations = true;
+    function();
+    is_counting_allocations = false;
+    return allocation_count;
+#endif
+}
\ No newline at end of file
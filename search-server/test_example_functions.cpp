@@ -0,0 +1,816 @@
+// The tests build into a program of their own: every source but main.cpp, compiled with SEARCH_SERVER_TESTS defined.
+// Other builds get neither the tests nor the allocation functions replaced for them
+#ifdef SEARCH_SERVER_TESTS
+#include "test_example_functions.h"
+#include "corpus_loader.h"
+#include "posting_codec.h"
+#include "process_queries.h"
+#include "search_server.h"
+#include "stop_word_set.h"
+#include "string_processing.h"
+#include "test_allocation_counter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+namespace {
+
+std::string MakeQuery(int plus_word_count, int minus_word_count) {
+    std::string query;
+    for (int i = 0; i < plus_word_count; ++i) {
+        query += "w"s + std::to_string(i) + ' ';
+    }
+    for (int i = 0; i < minus_word_count; ++i) {
+        query += "-w"s + std::to_string(plus_word_count + i) + ' ';
+    }
+    return query;
+}
+
+}
+
+void TestFindTopDocumentsAllocations() {
+    SearchServer search_server("and in"s);
+    for (int id = 0; id < 500; ++id) {
+        std::string text;
+        for (int word = 0; word < 8; ++word) {
+            text += "w"s + std::to_string((id * 7 + word * 13) % 64) + ' ';
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 5});
+    }
+
+    // The plus and minus terms of the index version and the heap of the top, which becomes the result. MaxScore adds
+    // its term bounds, cursors, minus cursors, bound prefix sums and the scores of a candidate by term
+    const std::pair<EvaluationMode, uint64_t> expected_counts[] = {{EvaluationMode::EXHAUSTIVE, 3}, {EvaluationMode::MAX_SCORE, 8}};
+    for (const auto& [mode, expected_count] : expected_counts) {
+        search_server.SetEvaluationMode(mode);
+        for (const int word_count : {3, 48}) {
+            const SearchServer::PreparedQuery query = search_server.PrepareQuery(MakeQuery(word_count * 2 / 3, word_count / 3));
+            // The first search sizes the buffers the thread keeps for the next ones
+            search_server.FindTopDocuments(query);
+            const uint64_t count = CountAllocations([&search_server, &query] {
+                search_server.FindTopDocuments(query);
+            });
+            if (count != expected_count) {
+                throw std::logic_error("FindTopDocuments made "s + std::to_string(count) + " allocations for "s + std::to_string(word_count)
+                                       + " words instead of "s + std::to_string(expected_count));
+            }
+        }
+    }
+}
+
+void TestMatchDocumentAllocations() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, MakeQuery(48, 0), DocumentStatus::ACTUAL, {1});
+    for (const int word_count : {3, 48}) {
+        const SearchServer::PreparedQuery query = search_server.PrepareQuery(MakeQuery(word_count, 0));
+        search_server.MatchDocument(query, 1);
+        // Only the matched words
+        const uint64_t count = CountAllocations([&search_server, &query] {
+            search_server.MatchDocument(query, 1);
+        });
+        if (count != 1) {
+            throw std::logic_error("MatchDocument made "s + std::to_string(count) + " allocations for "s + std::to_string(word_count)
+                                   + " matched words instead of 1"s);
+        }
+    }
+}
+
+void TestRelevanceIsTermFreqTimesInverseDocumentFreq() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(3, "bird"s, DocumentStatus::ACTUAL, {1});
+    search_server.RemoveDocument(3);
+    search_server.AddDocument(4, "fish"s, DocumentStatus::ACTUAL, {1});
+    const std::vector<Document> documents = search_server.FindTopDocuments("dog"s);
+    if (documents.size() != 1 || documents[0].relevance != 2.0 / 3.0 * std::log(3.0 / 1)) {
+        throw std::logic_error("Relevance is not the term frequency times log(document count / document frequency)"s);
+    }
+}
+
+void TestMaxScoreMatchesExhaustive() {
+    std::mt19937 generator(42);
+    const auto random_word = [&generator](int vocabulary_size) {
+        // Skewed, so some words are in most documents and others in few
+        const int rank = std::uniform_int_distribution(0, vocabulary_size - 1)(generator);
+        return "w"s + std::to_string(rank * rank / vocabulary_size);
+    };
+    for (const int document_count : {300, 10'000}) {
+        SearchServer search_server("and in"s);
+        for (int id = 0; id < document_count; ++id) {
+            std::string text;
+            for (int word = std::uniform_int_distribution(1, 12)(generator); word > 0; --word) {
+                text += random_word(200) + ' ';
+            }
+            // Distinct ratings leave no ties for the order of the top to depend on
+            search_server.AddDocument(id, text, id % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id});
+        }
+        for (int id = 0; id < document_count; id += 7) {
+            search_server.RemoveDocument(id);
+        }
+
+        for (int i = 0; i < 200; ++i) {
+            std::string query;
+            for (int word = std::uniform_int_distribution(1, 8)(generator); word > 0; --word) {
+                query += random_word(200) + ' ';
+            }
+            for (int word = std::uniform_int_distribution(0, 2)(generator); word > 0; --word) {
+                query += '-' + random_word(200) + ' ';
+            }
+            const size_t top_count = i % 2 == 0 ? 5 : 50;
+            search_server.SetEvaluationMode(EvaluationMode::EXHAUSTIVE);
+            const std::vector<Document> expected = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, top_count);
+            search_server.SetEvaluationMode(EvaluationMode::MAX_SCORE);
+            const std::vector<Document> documents = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, top_count);
+            const bool is_same = std::equal(documents.begin(), documents.end(), expected.begin(), expected.end(), [](const Document& lhs, const Document& rhs) {
+                return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+            });
+            if (!is_same) {
+                throw std::logic_error("MaxScore and exhaustive results differ for \""s + query + "\""s);
+            }
+        }
+    }
+}
+
+void TestDocumentsScoredCounter() {
+    if constexpr (!QUERY_PROFILING) {
+        return;
+    }
+    SearchServer search_server(""s);
+    for (int id = 0; id < 1000; ++id) {
+        search_server.AddDocument(id, id % 4 == 0 ? "cat dog"s : "dog"s, DocumentStatus::ACTUAL, {id});
+    }
+    for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        search_server.SetEvaluationMode(mode);
+        const SearchServer::SearchResult result = search_server.TraceTopDocuments("cat"s, DocumentStatus::ACTUAL, 1000);
+        if (result.trace->GetCount(QueryCounter::DOCUMENTS_SCORED) != 250) {
+            throw std::logic_error("Documents scored are not the documents of the query words"s);
+        }
+    }
+    // Once the top is full of documents with "cat", MaxScore skips those that have only "dog"
+    const SearchServer::SearchResult result = search_server.TraceTopDocuments("cat dog"s, DocumentStatus::ACTUAL, 5);
+    if (result.trace->GetCount(QueryCounter::DOCUMENTS_SCORED) >= 300) {
+        throw std::logic_error("MaxScore counted pruned candidates as scored"s);
+    }
+}
+
+void TestDeadlineKeepsFullyScoredDocuments() {
+    SearchServer search_server(""s);
+    // A sealed segment of the first 4096 documents and the buffer with the rest
+    for (int id = 0; id < 5000; ++id) {
+        search_server.AddDocument(id, id % 10 == 0 ? "cat dog"s : "cat"s, DocumentStatus::ACTUAL, {id});
+    }
+    std::map<int, double> relevances;
+    for (const Document& document : search_server.FindTopDocuments("cat dog"s, DocumentStatus::ACTUAL, 5000)) {
+        relevances[document.id] = document.relevance;
+    }
+
+    if (!search_server.FindTopDocuments(SearchDeadline::After(std::chrono::seconds(-1)), "cat dog"s).is_partial) {
+        throw std::logic_error("An expired search was not partial"s);
+    }
+    for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        search_server.SetEvaluationMode(mode);
+        // Cancelled from within, while the postings of the buffer are scored
+        CancellationToken token;
+        const SearchServer::SearchResult result = search_server.FindTopDocuments(SearchDeadline(token), "cat dog"s,
+                                                                                 [token](int document_id, DocumentStatus, int) mutable {
+            if (document_id >= 4500) {
+                token.Cancel();
+            }
+            return true;
+        }, 5000);
+        if (!result.is_partial || result.documents.empty()) {
+            throw std::logic_error("A cancelled search did not return the documents scored before"s);
+        }
+        for (const Document& document : result.documents) {
+            if (document.relevance != relevances.at(document.id)) {
+                throw std::logic_error("A cancelled search returned a document with only some of its postings scored"s);
+            }
+        }
+    }
+    // The exhaustive search drops the whole segment it was cancelled in
+    search_server.SetEvaluationMode(EvaluationMode::EXHAUSTIVE);
+    CancellationToken token;
+    const SearchServer::SearchResult result = search_server.FindTopDocuments(SearchDeadline(token), "cat dog"s,
+                                                                             [token](int document_id, DocumentStatus, int) mutable {
+        if (document_id >= 4500) {
+            token.Cancel();
+        }
+        return true;
+    }, 5000);
+    if (result.documents.size() != 4096) {
+        throw std::logic_error("A cancelled exhaustive search kept part of a segment"s);
+    }
+}
+
+void TestRemovedDocumentsUntilCompaction() {
+    SearchServer search_server(""s);
+    for (int id = 0; id < 6000; ++id) {
+        search_server.AddDocument(id, id % 2 == 0 ? "cat even"s : "cat odd"s, DocumentStatus::ACTUAL, {id});
+    }
+    // Half of the sealed segment and of the buffer
+    for (int id = 0; id < 6000; id += 2) {
+        search_server.RemoveDocument(id);
+    }
+    const auto check = [&search_server](const std::string& stage) {
+        const std::vector<Document> documents = search_server.FindTopDocuments("cat even odd"s, DocumentStatus::ACTUAL, 10'000);
+        const bool all_odd = std::all_of(documents.begin(), documents.end(), [](const Document& document) {
+            return document.id % 2 == 1;
+        });
+        const std::vector<int> ids(search_server.begin(), search_server.end());
+        if (documents.size() != 3000 || !all_odd || ids.size() != 3000 || search_server.GetDocumentCount() != 3000) {
+            throw std::logic_error("Removed documents are found "s + stage);
+        }
+        if (!search_server.FindTopDocuments("even"s).empty()) {
+            throw std::logic_error("A word of removed documents only is found "s + stage);
+        }
+        if (std::get<0>(search_server.MatchDocument("cat"s, 1)).size() != 1) {
+            throw std::logic_error("A live document does not match "s + stage);
+        }
+    };
+    check("before the compaction"s);
+    search_server.CompactRemovedDocuments();
+    check("after the compaction"s);
+    search_server.CompactIndex();
+    check("after the index is merged"s);
+
+    search_server.AddDocument(0, "even"s, DocumentStatus::ACTUAL, {0});
+    if (search_server.FindTopDocuments("even"s).size() != 1) {
+        throw std::logic_error("The id of a removed document can not be added again"s);
+    }
+}
+
+void TestWordFrequenciesOutliveSegments() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog dog"s, DocumentStatus::ACTUAL, {1});
+    const std::map<std::string_view, double>& word_freqs = search_server.GetWordFrequencies(1);
+    // Enough documents to seal the buffer and merge segments
+    for (int id = 2; id < 10'000; ++id) {
+        search_server.AddDocument(id, "bird w"s + std::to_string(id % 100), DocumentStatus::ACTUAL, {1});
+    }
+    search_server.CompactIndex();
+    if (&search_server.GetWordFrequencies(1) != &word_freqs || word_freqs.size() != 2 || word_freqs.count("dog"s) == 0) {
+        throw std::logic_error("Word frequencies did not outlive the segment of their document"s);
+    }
+
+    search_server.RemoveDocument(1);
+    search_server.AddDocument(1, "fox"s, DocumentStatus::ACTUAL, {1});
+    if (search_server.GetWordFrequencies(1).count("fox"s) == 0) {
+        throw std::logic_error("Word frequencies of a removed document were kept"s);
+    }
+}
+
+void TestWordFrequenciesFollowPublishedRemovals() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "bird"s, DocumentStatus::ACTUAL, {1});
+    search_server.SetUpdateMode(UpdateMode::SNAPSHOT);
+    const std::map<std::string_view, double>& removed_freqs = search_server.GetWordFrequencies(1);
+    const std::map<std::string_view, double>& kept_freqs = search_server.GetWordFrequencies(2);
+
+    search_server.RemoveDocument(1);
+    search_server.AddDocument(1, "fox"s, DocumentStatus::ACTUAL, {1});
+    // Queries still see the document removed from the draft
+    if (&search_server.GetWordFrequencies(1) != &removed_freqs || removed_freqs.count("dog"s) == 0) {
+        throw std::logic_error("Word frequencies of a published document changed before its removal was published"s);
+    }
+
+    search_server.PublishSnapshot();
+    if (search_server.GetWordFrequencies(1).count("fox"s) == 0) {
+        throw std::logic_error("Word frequencies of a removed document were kept after its removal was published"s);
+    }
+    if (&search_server.GetWordFrequencies(2) != &kept_freqs || kept_freqs.count("bird"s) == 0) {
+        throw std::logic_error("Word frequencies of a document that was not removed did not outlive a publication"s);
+    }
+
+    search_server.RemoveDocument(2);
+    search_server.SetUpdateMode(UpdateMode::IMMEDIATE);
+    if (!search_server.GetWordFrequencies(2).empty()) {
+        throw std::logic_error("Word frequencies of a removed document were kept after the switch to immediate updates"s);
+    }
+}
+
+void TestSnapshotIsolation() {
+    SearchServer search_server(""s);
+    for (int id = 0; id < 3000; ++id) {
+        search_server.AddDocument(id, "cat w"s + std::to_string(id), DocumentStatus::ACTUAL, {id});
+    }
+    search_server.SetUpdateMode(UpdateMode::SNAPSHOT);
+    int next_id = 3000;
+    // Rounds of updates and publications spread over many chunks of the dictionary and many small sealed segments
+    for (int round = 0; round < 20; ++round) {
+        const std::vector<Document> published = search_server.FindTopDocuments("cat w5 w2500"s, DocumentStatus::ACTUAL, 10'000);
+        const std::vector<int> published_ids(search_server.begin(), search_server.end());
+        const int published_count = search_server.GetDocumentCount();
+
+        const int first_new_id = next_id;
+        for (; next_id < first_new_id + 300; ++next_id) {
+            search_server.AddDocument(next_id, "cat w5 w2500 new"s + std::to_string(next_id), DocumentStatus::ACTUAL, {next_id});
+        }
+        search_server.RemoveDocument(round * 100);
+        search_server.RemoveDocument(first_new_id - 1);
+
+        const std::vector<Document> unpublished = search_server.FindTopDocuments("cat w5 w2500"s, DocumentStatus::ACTUAL, 10'000);
+        const bool same_results = std::equal(published.begin(), published.end(), unpublished.begin(), unpublished.end(),
+                                             [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance;
+        });
+        if (!same_results || std::vector<int>(search_server.begin(), search_server.end()) != published_ids
+            || search_server.GetDocumentCount() != published_count || !search_server.FindTopDocuments("new"s + std::to_string(first_new_id)).empty()) {
+            throw std::logic_error("Queries saw updates that were not published"s);
+        }
+
+        search_server.PublishSnapshot();
+        const int expected_count = published_count + 298;
+        if (search_server.GetDocumentCount() != expected_count || search_server.FindTopDocuments("new"s + std::to_string(first_new_id)).size() != 1
+            || !search_server.FindTopDocuments("new"s + std::to_string(first_new_id - 1)).empty()
+            || std::vector<int>(search_server.begin(), search_server.end()).size() != static_cast<size_t>(expected_count)) {
+            throw std::logic_error("Queries did not see published updates"s);
+        }
+    }
+}
+
+void TestPostingCodecRoundTrip() {
+    std::mt19937 generator(7);
+    for (int bits = 0; bits < 32; ++bits) {
+        for (const size_t count : {1, 7, 8, 9, 100, 128}) {
+            const int max_value = static_cast<int>((uint64_t{1} << bits) - 1);
+            std::vector<int> values(count);
+            for (int& value : values) {
+                value = std::uniform_int_distribution<int>(0, max_value)(generator);
+            }
+            // Values of every width, so the block takes exactly the bits of the widest
+            values[count / 2] = max_value;
+            std::vector<uint8_t> data(3, 0xFF);
+            const int packed_bits = PackBits(values.data(), count, data);
+            if (packed_bits != bits || data.size() != 3 + GetPackedSize(bits, count)) {
+                throw std::logic_error("Values are packed in more bits than the widest needs"s);
+            }
+            data.resize(data.size() + PACKED_DATA_PADDING, 0xFF);
+            std::vector<int> unpacked(count);
+            UnpackBits(data.data() + 3, packed_bits, count, unpacked.data());
+            if (unpacked != values) {
+                throw std::logic_error("Values packed in "s + std::to_string(bits) + " bits do not unpack to themselves"s);
+            }
+        }
+    }
+}
+
+void TestProcessQueriesMatchesSingleQueries() {
+    SearchServer search_server(""s);
+    for (int id = 0; id < 20'000; ++id) {
+        search_server.AddDocument(id, "cat w"s + std::to_string(id % 1000) + " v"s + std::to_string(id % 37), DocumentStatus::ACTUAL, {id % 11});
+    }
+    // One query far costlier than the rest, which is split wherever there are threads to share it
+    std::vector<std::string> queries = {"cat v3 -w5"s};
+    for (int query = 0; query < 200; ++query) {
+        queries.push_back("w"s + std::to_string(query * 7 % 1000) + " v"s + std::to_string(query % 37));
+    }
+    for (const EvaluationMode mode : {EvaluationMode::EXHAUSTIVE, EvaluationMode::MAX_SCORE}) {
+        search_server.SetEvaluationMode(mode);
+        const std::vector<std::vector<Document>> results = ProcessQueries(search_server, queries);
+        for (size_t query = 0; query < queries.size(); ++query) {
+            const std::vector<Document> expected = search_server.FindTopDocuments(queries[query]);
+            const bool same = std::equal(results[query].begin(), results[query].end(), expected.begin(), expected.end(),
+                                         [](const Document& lhs, const Document& rhs) {
+                return lhs.id == rhs.id && std::abs(lhs.relevance - rhs.relevance) < 1e-12;
+            });
+            if (!same || expected.empty()) {
+                throw std::logic_error("A batch query found other documents than the query alone: "s + queries[query]);
+            }
+        }
+    }
+}
+
+void TestSavedIndexLoadsTheSame() {
+    SearchServer search_server("and the"s);
+    for (int id = 0; id < 5000; ++id) {
+        search_server.AddDocument(id, "the cat and w"s + std::to_string(id % 300) + " v"s + std::to_string(id % 7), DocumentStatus::ACTUAL,
+                                  {id % 5});
+    }
+    search_server.RemoveDocument(7);
+    search_server.RemoveDocument(4500);
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.index").string();
+    search_server.SaveIndex(path);
+    SearchServer loaded = SearchServer::LoadIndex(path);
+
+    const std::vector<std::string> queries = {"cat w7 -v3"s, "the w299 v6"s, "v0 w1"s};
+    for (const std::string& query : queries) {
+        const std::vector<Document> expected = search_server.FindTopDocuments(query);
+        const std::vector<Document> documents = loaded.FindTopDocuments(query);
+        const bool same = std::equal(documents.begin(), documents.end(), expected.begin(), expected.end(), [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        });
+        if (!same) {
+            throw std::logic_error("A loaded index finds other documents for "s + query);
+        }
+    }
+    if (loaded.GetDocumentCount() != search_server.GetDocumentCount()
+        || std::vector<int>(loaded.begin(), loaded.end()) != std::vector<int>(search_server.begin(), search_server.end())
+        || loaded.GetWordFrequencies(8) != search_server.GetWordFrequencies(8) || !loaded.GetWordFrequencies(7).empty()) {
+        throw std::logic_error("A loaded index has other documents"s);
+    }
+    if (!loaded.FindTopDocuments("the"s).empty()) {
+        throw std::logic_error("A loaded index lost its stop words"s);
+    }
+    loaded.AddDocument(7, "fox w1"s, DocumentStatus::ACTUAL, {1});
+    if (loaded.FindTopDocuments("fox"s).size() != 1 || loaded.FindTopDocuments("w1"s, DocumentStatus::ACTUAL, 100).size() != 18) {
+        throw std::logic_error("Documents added to a loaded index are not found"s);
+    }
+
+    const auto expect_rejected = [&path](const std::string& damage) {
+        try {
+            SearchServer::LoadIndex(path);
+        } catch (const std::runtime_error&) {
+            return;
+        }
+        throw std::logic_error("An index file with "s + damage + " was loaded"s);
+    };
+    const uintmax_t size = std::filesystem::file_size(path);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(static_cast<std::streamoff>(size / 2));
+        file.put('\x5A');
+    }
+    expect_rejected("a damaged byte"s);
+    std::filesystem::resize_file(path, size - 8);
+    expect_rejected("its end cut off"s);
+    std::filesystem::resize_file(path, 10);
+    expect_rejected("its header cut off"s);
+    std::filesystem::remove(path);
+    expect_rejected("no file"s);
+}
+
+void TestCorpusLoaderReportsBadLines() {
+    const auto check_errors = [](const std::vector<SearchServer::DocumentError>& errors, const std::vector<size_t>& expected_lines,
+                                 const std::string& format) {
+        std::vector<size_t> lines;
+        for (const SearchServer::DocumentError& error : errors) {
+            lines.push_back(error.position);
+        }
+        if (lines != expected_lines) {
+            throw std::logic_error("The "s + format + " loader reported other lines than the bad ones"s);
+        }
+    };
+
+    // Chunks far shorter than the lines, so lines span chunks
+    SearchServer tsv_server(""s);
+    std::istringstream tsv_input(
+        "1\tACTUAL\t5 7\tfluffy cat\n"s
+        "x\tACTUAL\t1\tbad id\n"s
+        "\n"s
+        "2\tSOLD\t1\tbad status\n"s
+        "3\tBANNED\t1,2\r\n"s
+        "1\tACTUAL\t1\tsame id\n"s
+        "4\t1\t\tgroomed dog\r\n"s
+        "5\tACTUAL\t2\tcontrol\x01word\n"s
+        "6\t0\t-3\tlast line without a break"s);
+    check_errors(LoadCorpus(tsv_server, tsv_input, CorpusFormat::TSV, 8), {2, 4, 5, 6, 8}, "TSV"s);
+    const std::vector<int> tsv_ids(tsv_server.begin(), tsv_server.end());
+    if (tsv_ids != std::vector<int>{1, 4, 6} || tsv_server.FindTopDocuments("dog"s, DocumentStatus::IRRELEVANT).size() != 1
+        || tsv_server.FindTopDocuments("cat"s)[0].rating != 6) {
+        throw std::logic_error("The TSV loader did not add the good lines as they are"s);
+    }
+
+    SearchServer json_server(""s);
+    std::istringstream json_input(
+        R"({"id": 1, "status": "ACTUAL", "ratings": [4], "text": "caf\u00e9 \"quoted\" cat", "extra": {"a": [1, null]}})"s + "\n"s
+        + R"({"status": "ACTUAL", "text": "no id"})"s + "\n"s
+        + R"({"id": 2, "text": "unterminated})"s + "\n"s
+        + R"({"id": 3, "text": "dog"} trailing)"s + "\n"s
+        + R"({"id": 4, "ratings": [], "text": "dog"})"s + "\n"s);
+    check_errors(LoadCorpus(json_server, json_input, CorpusFormat::JSONL, 16), {2, 3, 4}, "JSON"s);
+    if (std::vector<int>(json_server.begin(), json_server.end()) != std::vector<int>{1, 4}
+        || json_server.FindTopDocuments("caf\xC3\xA9"s).size() != 1 || json_server.FindTopDocuments("\"quoted\""s).size() != 1) {
+        throw std::logic_error("The JSON loader did not decode the good lines"s);
+    }
+}
+
+void TestSplitIntoWordsMatchesByteScan() {
+    // Spaces, letters, control characters and bytes from 128, which are negative as chars and are no control characters
+    const std::string alphabet = " ab\x01\x1f\x7f\x80\xff"s;
+    std::mt19937 generator(11);
+    for (int round = 0; round < 2000; ++round) {
+        // Lengths around the widths of the vector blocks
+        std::string text(std::uniform_int_distribution<size_t>(0, 100)(generator), ' ');
+        // Every other text has only spaces and letters
+        std::uniform_int_distribution<size_t> character(0, round % 2 == 0 ? 2 : alphabet.size() - 1);
+        for (char& c : text) {
+            c = alphabet[character(generator)];
+        }
+
+        std::vector<std::string_view> expected_words = {"kept"};
+        bool expected_valid = true;
+        size_t word_begin = 0;
+        for (size_t position = 0; position <= text.size(); ++position) {
+            if (position == text.size() || text[position] == ' ') {
+                if (position > word_begin) {
+                    expected_words.push_back(std::string_view(text).substr(word_begin, position - word_begin));
+                }
+                word_begin = position + 1;
+            } else if (static_cast<unsigned char>(text[position]) < 32) {
+                expected_valid = false;
+            }
+        }
+
+        std::vector<std::string_view> words = {"kept"};
+        const bool valid = SplitIntoWords(text, words);
+        if (words != expected_words || valid != expected_valid) {
+            throw std::logic_error("SplitIntoWords splits a text of "s + std::to_string(text.size()) + " bytes otherwise than a scan byte by byte"s);
+        }
+    }
+}
+
+void TestStopWordSetMatchesOrderedSet() {
+    std::mt19937 generator(13);
+    const auto make_word = [&generator]() {
+        // Lengths on both sides of the eight-byte chunks the hash reads
+        std::string word(std::uniform_int_distribution<size_t>(1, 20)(generator), 'a');
+        for (char& c : word) {
+            c = static_cast<char>(std::uniform_int_distribution<int>(33, 255)(generator));
+        }
+        return word;
+    };
+    for (const size_t size : {0, 1, 2, 3, 17, 500, 3000}) {
+        std::vector<std::string> words;
+        for (size_t i = 0; i < size; ++i) {
+            words.push_back(make_word());
+        }
+        // Repeated and empty words are dropped
+        if (size > 0) {
+            words.push_back(words.front());
+        }
+        words.push_back(""s);
+        const std::set<std::string, std::less<>> expected(words.begin(), words.end());
+        const StopWordSet stop_words(std::vector<std::string_view>(words.begin(), words.end()));
+
+        std::vector<std::string_view> expected_words(expected.begin(), expected.end());
+        expected_words.erase(std::remove(expected_words.begin(), expected_words.end(), std::string_view()), expected_words.end());
+        if (stop_words.GetWords() != expected_words || stop_words.GetSize() != expected_words.size()
+            || stop_words.IsEmpty() != expected_words.empty()) {
+            throw std::logic_error("A stop word set of "s + std::to_string(size) + " words keeps other words"s);
+        }
+
+        // Members, other words, and near misses: the members with a byte changed, cut short or made longer
+        std::vector<std::string> probes(words.begin(), words.end());
+        for (size_t i = 0; i < 2000; ++i) {
+            probes.push_back(make_word());
+        }
+        for (size_t i = 0; i < std::min<size_t>(size, 200); ++i) {
+            std::string word = words[i];
+            probes.push_back(word + "x"s);
+            probes.push_back(word.substr(0, word.size() - 1));
+            word.back() = static_cast<char>(word.back() + 1);
+            probes.push_back(word);
+        }
+        for (const std::string& probe : probes) {
+            if (stop_words.Contains(probe) != (!probe.empty() && expected.count(probe) > 0)) {
+                throw std::logic_error("A stop word set of "s + std::to_string(size) + " words is wrong about a word of "s
+                                       + std::to_string(probe.size()) + " bytes"s);
+            }
+        }
+    }
+}
+
+void TestQueryCacheFollowsNewWords() {
+    SearchServer cached("and"s);
+    SearchServer uncached("and"s);
+    cached.SetQueryCacheCapacity(2);
+    if (cached.GetQueryCacheCapacity() != 2 || uncached.GetQueryCacheCapacity() != 0) {
+        throw std::logic_error("The query cache keeps another capacity than the one set"s);
+    }
+    const auto add_documents = [&](int first_id, const std::string& word) {
+        for (int id = first_id; id < first_id + 50; ++id) {
+            const std::string text = "cat and "s + word + " w"s + std::to_string(id % 9);
+            cached.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 4});
+            uncached.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 4});
+        }
+    };
+    const auto same_documents = [](const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& left, const Document& right) {
+            return left.id == right.id && left.relevance == right.relevance && left.rating == right.rating;
+        });
+    };
+
+    // Three queries through a cache of two evict one another; their words dog and -bird come only with later documents
+    const std::vector<std::string> queries = {"cat dog"s, "w3 dog -bird"s, "bird w1"s};
+    const SearchServer::PreparedQuery prepared = cached.PrepareQuery(queries[1]);
+    add_documents(0, "fox"s);
+    for (const std::string& word : {"dog"s, "bird"s}) {
+        for (int round = 0; round < 2; ++round) {
+            for (const std::string& query : queries) {
+                if (!same_documents(cached.FindTopDocuments(query), uncached.FindTopDocuments(query))) {
+                    throw std::logic_error("A cached query finds other documents: "s + query);
+                }
+            }
+        }
+        add_documents(word == "dog"s ? 100 : 200, word);
+    }
+    const std::vector<Document> prepared_documents = cached.FindTopDocuments(prepared);
+    if (!same_documents(prepared_documents, uncached.FindTopDocuments(queries[1])) || prepared_documents.empty()) {
+        throw std::logic_error("A prepared query misses the words added after it"s);
+    }
+    for (const int id : {3, 103, 203}) {
+        if (cached.MatchDocument(prepared, id) != uncached.MatchDocument(queries[1], id)
+            || cached.MatchDocument(queries[2], id) != uncached.MatchDocument(queries[2], id)) {
+            throw std::logic_error("A cached query matches other words of document "s + std::to_string(id));
+        }
+    }
+
+    cached.SetQueryCacheCapacity(0);
+    add_documents(300, "dog"s);
+    if (cached.GetQueryCacheCapacity() != 0
+        || !same_documents(cached.FindTopDocuments(queries[0]), uncached.FindTopDocuments(queries[0]))) {
+        throw std::logic_error("A disabled query cache changes the results"s);
+    }
+}
+
+void TestResultCacheFollowsUpdates() {
+    SearchServer cached(""s);
+    SearchServer uncached(""s);
+    cached.SetResultCacheCapacity(1600);
+    const auto add_document = [&](int id, DocumentStatus status) {
+        const std::string text = "cat w"s + std::to_string(id % 10) + " v"s + std::to_string(id % 3);
+        cached.AddDocument(id, text, status, {id % 6});
+        uncached.AddDocument(id, text, status, {id % 6});
+    };
+    for (int id = 0; id < 300; ++id) {
+        add_document(id, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL);
+    }
+    const auto same_documents = [](const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& left, const Document& right) {
+            return left.id == right.id && std::abs(left.relevance - right.relevance) < 1e-12 && left.rating == right.rating;
+        });
+    };
+    const auto check = [&](const std::string& query, DocumentStatus status, size_t top_count, uint64_t hits, uint64_t misses) {
+        const std::vector<Document> documents = cached.FindTopDocuments(query, status, top_count);
+        const std::vector<Document> expected = uncached.FindTopDocuments(query, status, top_count);
+        const ResultCache::Stats stats = cached.GetResultCacheStats();
+        if (!same_documents(documents, expected) || expected.empty() || stats.hits != hits || stats.misses != misses) {
+            throw std::logic_error("The result cache answers "s + query + " wrong or counts it wrong"s);
+        }
+    };
+
+    check("cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 0, 1);
+    check("cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 1, 1);
+    check("w1 cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 2, 1);
+    check("cat w1"s, DocumentStatus::BANNED, MAX_RESULT_DOCUMENT_COUNT, 2, 2);
+    check("cat w1"s, DocumentStatus::ACTUAL, 3, 2, 3);
+    check("cat w1 -v2"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 2, 4);
+    if (cached.GetResultCacheStats().size != 4) {
+        throw std::logic_error("The result cache keeps other entries than the searches made"s);
+    }
+
+    // Updates leave the entries stale, so the same searches miss and see them
+    add_document(1001, DocumentStatus::ACTUAL);
+    check("cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 2, 5);
+    check("cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 3, 5);
+    cached.RemoveDocument(1001);
+    uncached.RemoveDocument(1001);
+    check("cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 3, 6);
+
+    // A batch run twice is answered from the cache the second time, duplicates included
+    std::vector<std::string> queries;
+    for (int query = 0; query < 100; ++query) {
+        queries.push_back("w"s + std::to_string(query % 10) + " v"s + std::to_string(query % 3));
+    }
+    const ResultCache::Stats before = cached.GetResultCacheStats();
+    ProcessQueries(cached, queries);
+    const ResultCache::Stats middle = cached.GetResultCacheStats();
+    const std::vector<std::vector<Document>> results = ProcessQueries(cached, queries);
+    if (middle.hits + middle.misses != before.hits + before.misses + queries.size()
+        || cached.GetResultCacheStats().hits != middle.hits + queries.size()) {
+        throw std::logic_error("A repeated batch is not answered from the result cache"s);
+    }
+    for (size_t query = 0; query < queries.size(); ++query) {
+        if (!same_documents(results[query], uncached.FindTopDocuments(queries[query]))) {
+            throw std::logic_error("A cached batch query finds other documents: "s + queries[query]);
+        }
+    }
+
+    cached.SetResultCacheCapacity(0);
+    const ResultCache::Stats disabled = cached.GetResultCacheStats();
+    check("cat w1"s, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, disabled.hits, disabled.misses);
+    if (disabled.size != 0 || cached.GetResultCacheStats().size != 0) {
+        throw std::logic_error("A disabled result cache keeps entries"s);
+    }
+}
+
+void TestJoinedDocumentsMatchProcessQueries() {
+    SearchServer search_server(""s);
+    for (int id = 0; id < 3000; ++id) {
+        search_server.AddDocument(id, "cat w"s + std::to_string(id % 100) + " v"s + std::to_string(id % 7), DocumentStatus::ACTUAL, {id % 9});
+    }
+    // Queries that find nothing at the start, in the middle and at the end
+    std::vector<std::string> queries = {"dog"s, "-cat"s};
+    for (int query = 0; query < 60; ++query) {
+        queries.push_back(query % 10 == 3 ? "bird"s : "w"s + std::to_string(query * 3 % 100) + " v"s + std::to_string(query % 7));
+    }
+    queries.push_back("dog"s);
+    const std::vector<std::vector<Document>> expected = ProcessQueries(search_server, queries);
+    std::vector<Document> expected_joined;
+    for (const std::vector<Document>& documents : expected) {
+        expected_joined.insert(expected_joined.end(), documents.begin(), documents.end());
+    }
+    const auto same_documents = [](const auto& lhs, const auto& rhs) {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& left, const Document& right) {
+            return left.id == right.id && std::abs(left.relevance - right.relevance) < 1e-12 && left.rating == right.rating;
+        });
+    };
+
+    std::optional<JoinedDocuments> moved_from;
+    {
+        // The queries need not outlive the object
+        const std::vector<std::string> query_copies = queries;
+        moved_from.emplace(ProcessQueriesJoined(search_server, query_copies));
+    }
+    const JoinedDocuments joined(std::move(*moved_from));
+    moved_from.reset();
+    if (joined.GetQueryCount() != queries.size() || joined.size() != expected_joined.size() || !same_documents(joined, expected_joined)) {
+        throw std::logic_error("Joined documents differ from the batch results"s);
+    }
+    for (size_t query = 0; query < queries.size(); ++query) {
+        if (!same_documents(joined.GetQueryDocuments(query), expected[query])) {
+            throw std::logic_error("Joined documents of query "s + std::to_string(query) + " differ from the batch results"s);
+        }
+    }
+    const JoinedDocuments nothing = ProcessQueriesJoined(search_server, {"dog"s, "bird"s});
+    if (nothing.begin() != nothing.end() || nothing.size() != 0) {
+        throw std::logic_error("Queries that find nothing join into documents"s);
+    }
+    const JoinedDocuments no_queries = ProcessQueriesJoined(search_server, {});
+    if (no_queries.begin() != no_queries.end() || no_queries.GetQueryCount() != 0) {
+        throw std::logic_error("An empty batch joins into documents"s);
+    }
+
+    // Pages of the forward iterators of the joined documents and of a vector split alike
+    for (const size_t page_size : {size_t{1}, size_t{7}, expected_joined.size(), expected_joined.size() + 5}) {
+        const auto pages = Paginate(joined, page_size);
+        const auto vector_pages = Paginate(expected_joined, page_size);
+        if (pages.size() != (expected_joined.size() + page_size - 1) / page_size || pages.size() != vector_pages.size()) {
+            throw std::logic_error("Pages of "s + std::to_string(page_size) + " documents are counted wrong"s);
+        }
+        auto vector_page = vector_pages.begin();
+        std::vector<Document> paged;
+        for (const auto& page : pages) {
+            const auto size = static_cast<size_t>(std::distance(page.begin(), page.end()));
+            const bool last = &page == &*std::prev(pages.end());
+            if (size == 0 || size > page_size || (!last && size != page_size) || !same_documents(page, *vector_page++)) {
+                throw std::logic_error("A page of "s + std::to_string(page_size) + " documents is split wrong"s);
+            }
+            paged.insert(paged.end(), page.begin(), page.end());
+        }
+        if (!same_documents(paged, expected_joined)) {
+            throw std::logic_error("Pages of "s + std::to_string(page_size) + " documents lose documents"s);
+        }
+    }
+    try {
+        Paginate(nothing, 3);
+        throw std::logic_error("Pages of nothing were made"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void TestSearchServer() {
+    TestFindTopDocumentsAllocations();
+    TestMatchDocumentAllocations();
+    TestRelevanceIsTermFreqTimesInverseDocumentFreq();
+    TestMaxScoreMatchesExhaustive();
+    TestDocumentsScoredCounter();
+    TestDeadlineKeepsFullyScoredDocuments();
+    TestRemovedDocumentsUntilCompaction();
+    TestWordFrequenciesOutliveSegments();
+    TestWordFrequenciesFollowPublishedRemovals();
+    TestSnapshotIsolation();
+    TestPostingCodecRoundTrip();
+    TestProcessQueriesMatchesSingleQueries();
+    TestSavedIndexLoadsTheSame();
+    TestCorpusLoaderReportsBadLines();
+    TestSplitIntoWordsMatchesByteScan();
+    TestStopWordSetMatchesOrderedSet();
+    TestQueryCacheFollowsNewWords();
+    TestResultCacheFollowsUpdates();
+    TestJoinedDocumentsMatchProcessQueries();
+}
+
+int main() {
+    TestSearchServer();
+    std::cout << "All tests passed"s << std::endl;
+    return 0;
+}
+#endif
\ No newline at end of file
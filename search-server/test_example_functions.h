@@ -0,0 +1,23 @@
+#pragma once
+
+// Throw std::logic_error describing the first failed check
+void TestFindTopDocumentsAllocations();
+void TestMatchDocumentAllocations();
+void TestRelevanceIsTermFreqTimesInverseDocumentFreq();
+void TestMaxScoreMatchesExhaustive();
+void TestDocumentsScoredCounter();
+void TestDeadlineKeepsFullyScoredDocuments();
+void TestRemovedDocumentsUntilCompaction();
+void TestWordFrequenciesOutliveSegments();
+void TestWordFrequenciesFollowPublishedRemovals();
+void TestSnapshotIsolation();
+void TestPostingCodecRoundTrip();
+void TestProcessQueriesMatchesSingleQueries();
+void TestSavedIndexLoadsTheSame();
+void TestCorpusLoaderReportsBadLines();
+void TestSplitIntoWordsMatchesByteScan();
+void TestStopWordSetMatchesOrderedSet();
+void TestQueryCacheFollowsNewWords();
+void TestResultCacheFollowsUpdates();
+void TestJoinedDocumentsMatchProcessQueries();
+void TestSearchServer();
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+
+TopDocuments::TopDocuments(size_t capacity) : capacity_(capacity) {
+    heap_.reserve(std::min(capacity, max_reserved_count_));
+}
+
+void TopDocuments::Add(const Document& document) {
+    if (heap_.size() < capacity_) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (capacity_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+bool TopDocuments::IsFull() const {
+    return capacity_ > 0 && heap_.size() == capacity_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+std::vector<Document> TopDocuments::Extract() {
+    std::sort(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return std::move(heap_);
+}
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < relevance_flag) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+#include "document.h"
+
+#include <vector>
+
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t capacity);
+
+    void Add(const Document& document);
+
+    bool IsFull() const;
+    const Document& GetWorst() const;
+
+    std::vector<Document> Extract();
+
+private:
+    // Larger tops, up to all documents, grow the heap as they fill it
+    static constexpr size_t max_reserved_count_ = 1024;
+
+    size_t capacity_;
+    std::vector<Document> heap_;
+};
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
\ No newline at end of file